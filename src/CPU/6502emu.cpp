@@ -64,6 +64,7 @@ cpu6502::cpu6502(Memory& mem) : memory(mem), wrapper(mem, nullptr, false)
     ps.i = 1;
     ps._ = 1;
     s = 0xff;
+    cycleCount = 0;
 }
 
 /* ---------- HELPER FUNCTIONS ---------- */
@@ -73,8 +74,48 @@ void cpu6502::decStack() { if (s > 0) s--; }
 uint8_t cpu6502::parseProcessorStatus() { return ps.val; }
 void cpu6502::unparseProcessorStatus(const uint8_t status) { ps.val = status; }
 
+/* ---------- SNAPSHOTS ---------- */
+
+void cpu6502::saveState(CPUState& state) const
+{
+    state.a = a;
+    state.x = x;
+    state.y = y;
+    state.s = s;
+    state.ps = ps.val;
+    state.pc = pc.val;
+    state.cycleCount = cycleCount;
+}
+
+void cpu6502::loadState(const CPUState& state)
+{
+    a = state.a;
+    x = state.x;
+    y = state.y;
+    s = state.s;
+    ps.val = state.ps;
+    pc.val = state.pc;
+    cycleCount = state.cycleCount;
+}
+
 /* ---------- FUNCTIONS ---------- */
 
+// Addressing mode of the indexed reads that take an extra cycle when they cross a page (IMPLIED for every other opcode)
+static AddressingMode pageCrossingMode(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x11: case 0x31: case 0x51: case 0x71: case 0xb1: case 0xd1: case 0xf1:
+            return ZERO_PAGE_INDIRECT_Y_INDEXED;
+        case 0x19: case 0x39: case 0x59: case 0x79: case 0xb9: case 0xbe: case 0xd9: case 0xf9:
+            return Y_INDEXED_ABSOLUTE;
+        case 0x1d: case 0x3d: case 0x5d: case 0x7d: case 0xbc: case 0xbd: case 0xdd: case 0xfd:
+            return X_INDEXED_ABSOLUTE;
+        default:
+            return IMPLIED;
+    }
+}
+
 int cpu6502::interrupt_handler(InterruptType type)
 {
     // If interrupt disable is on, abort immediately (except when it is NMI)
@@ -87,8 +128,13 @@ int cpu6502::interrupt_handler(InterruptType type)
     }
 
     
-    // PC incremented to PC + 2 (pc is already incremented once duriing emulate() )
-    pc.val++;
+    /*
+     Return address pushed for RTI:
+        NMI / IRQ are taken between instructions, so PC already points at the next instruction
+        BRK returns to PC + 2 (pc is already incremented once during emulate(), the padding byte is skipped here)
+     */
+    if (type == InterruptType::BRK)
+        pc.val++;
     
     //Push PC onto stack
     memory[0x100 | s] = pc.hi;
@@ -104,6 +150,10 @@ int cpu6502::interrupt_handler(InterruptType type)
     //Set Interrupt Flag
     ps.i = 1;
     
+    // BRK's cycles are already counted by emulate()
+    if (type != InterruptType::BRK)
+        cycleCount += 7;
+    
     //Load Interrupt vector into memory
     switch (type) {
         
@@ -132,6 +182,18 @@ int cpu6502::interrupt_handler(InterruptType type)
     return 7; // Number of cycles
 }
 
+uint64_t cpu6502::run(uint64_t untilCycle)
+{
+    uint64_t start = cycleCount;
+    
+    while (cycleCount < untilCycle)
+    {
+        emulate();
+    }
+    
+    return cycleCount - start;
+}
+
 int cpu6502::emulate()
 {
     using namespace AddressingModeFuncs;
@@ -166,6 +228,11 @@ int cpu6502::emulate()
     
     int cycles = base_cycles[*opcode];
     
+    // Register reads/writes land on the last cycle of most instructions, which a page crossing pushes back by one.
+    // The crossing is known from the operand before anything is read (branches take their penalty without any access)
+    const int accessPenalty = detectPageCross(this, opcode, pageCrossingMode(*opcode));
+    memory.setAccessCycle(cycleCount + cycles + accessPenalty - 1);
+    
     switch (*opcode)
     {
         case 0x00: //BRK
@@ -625,6 +692,10 @@ int cpu6502::emulate()
     std::cout << " A: " << static_cast<int>(this->a) << " X: " << static_cast<int>(this->x) << " Y: " << static_cast<int>(this->y) << " S: " << static_cast<int>(this->s) << std::endl;
     std::cout << "C: " << static_cast<int>(this->ps.c) << " Z: " << static_cast<int>(this->ps.z) << " I: " << static_cast<int>(this->ps.i) << " D: " << static_cast<int>(this->ps.d) << " B: " << static_cast<int>(this->ps.b) << " V: " << static_cast<int>(this->ps.v) << " N: " << static_cast<int>(this->ps.n) << std::endl;
     
+    // e.g. STA $4014 halts the CPU for the OAM DMA
+    cycles += memory.takeStallCycles();
+    
+    cycleCount += cycles;
     
     return cycles;
 }
@@ -16,6 +16,15 @@
 
 enum class InterruptType { BRK, IRQ, RESET, NMI };
 
+// Registers of the CPU at an instruction boundary, for snapshots
+struct CPUState
+{
+    uint8_t a, x, y, s;
+    uint8_t ps;
+    uint16_t pc;
+    uint64_t cycleCount;
+};
+
 /*
  Physical 6502 CPU class
  
@@ -50,6 +59,8 @@ public:
     uint8_t y;  //Y index register
     uint8_t s;  //Stack pointer
     
+    uint64_t cycleCount; // Cycles executed since power up
+    
     Memory& memory; // Memory
     MemWrapper wrapper; // Wrapper for controlling the reading/writing of memory
     
@@ -86,6 +97,14 @@ public:
     /* ---------- FUNCTIONS ---------- */
     
     int emulate();
+    
+    /**
+     *  Executes instructions until the cycle count reaches untilCycle (usually the next scheduled event)
+     *
+     *  @param untilCycle CPU cycle to run up to
+     *  @return Number of cycles executed (may overshoot untilCycle by the length of the last instruction)
+     */
+    uint64_t run(uint64_t untilCycle);
     void disassemble();
     int interrupt_handler(InterruptType type);
     
@@ -96,6 +115,12 @@ public:
     
     uint8_t parseProcessorStatus();
     void unparseProcessorStatus(const uint8_t status);
+    
+    /* ---------- SNAPSHOTS ---------- */
+    
+    // Only valid between instructions (memory is saved separately)
+    void saveState(CPUState& state) const;
+    void loadState(const CPUState& state);
 };
 
 #endif /* _502emu_hpp */
@@ -497,13 +497,11 @@ namespace Instructions
         cpu->incStack();
         cpu->unparseProcessorStatus(cpu->memory[0x100 | (cpu->s)]);
         
-        //Load program counter (subtract by one to get exact memory address next time through)
+        //Load program counter (interrupts push the exact address to resume at, unlike JSR)
         cpu->incStack();
         cpu->pc.lo = cpu->memory[0x100 | (cpu->s)];
         cpu->incStack();
         cpu->pc.hi = cpu->memory[0x100 | (cpu->s)];
-        
-        cpu->pc.val--;
     }
 
     void RTS(cpu6502 *const cpu)
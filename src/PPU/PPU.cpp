@@ -10,8 +10,44 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <iostream>
+#include <algorithm>
 
-PPU::PPU(Memory& mem, GUI* gui) : memory(mem), gui(gui), palette("../../res/Composite_wiki.pal")
+// Reverses the bits of a pattern row, used to flip sprites horizontally
+static uint8_t reverseBits(uint8_t b)
+{
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+    return b;
+}
+
+// Same as PPU::fineYIncrement(), but on a raw copy of internal register v
+static uint16_t fineYIncremented(uint16_t v)
+{
+    if ((v & 0x7000) != 0x7000)
+        return v + 0x1000;
+    
+    v &= ~0x7000;
+    uint16_t coarseY = (v & 0x03E0) >> 5;
+    
+    if (coarseY == 29)
+    {
+        coarseY = 0;
+        v ^= 0x0800;
+    }
+    else if (coarseY == 31)
+    {
+        coarseY = 0;
+    }
+    else
+    {
+        coarseY++;
+    }
+    
+    return (v & ~0x03E0) | (coarseY << 5);
+}
+
+PPU::PPU(Memory& mem, VideoSink* sink) : sink(sink), memory(mem), m_region(Region::NTSC), m_scheduler(nullptr)
 {
     powerResetState(false);
 }
@@ -24,13 +60,51 @@ void PPU::powerResetState(bool isReset)
     m_regs.PPUSTATUS.val = (isReset) ? m_regs.PPUSTATUS.val | 0x80 : 0xa0;
     m_regs.PPUSCROLL = 0;
     m_regs.PPUDATA = 0;
+    m_intRegs.w = 0;
     
     // Registers that are only changed by Power on events
     if (!isReset)
     {
         m_regs.OAMADDR = 0;
         m_regs.PPUADDR.val = 0;
+        m_intRegs.v.val = 0;
+        m_intRegs.t.val = 0;
+        m_intRegs.x = 0;
+        m_OAM.fill(0xFF);
+    }
+    
+    m_spriteLinesDirty = true;
+    m_spriteZeroPredictionDirty = true;
+    
+    if (!isReset)
+    {
+        m_nametableWrites.fill(0);
+        m_chrWrites.fill(0);
+        m_vramWriteSeq = 0;
+        m_bgCacheEnabled = true;
+        invalidateBackgroundCache();
+        
+        m_journal = RasterJournal();
+        m_lastJournal = RasterJournal();
+        m_deferredRendering = false;
     }
+    
+    // Timing starts at the top of an even frame, which gets rendered
+    m_scanline = 0;
+    m_dot = 0;
+    m_oddFrame = false;
+    m_nmiPending = false;
+    m_frameEnded = false;
+    
+    if (!isReset)
+    {
+        m_frameCount = 0;
+        m_dotCount = 0;
+        m_renderNextFrame = true;
+        m_renderingThisFrame = true;
+    }
+    
+    m_readBuffer = 0;
 }
 
 /* --------------- READ WRITE FUNCTIONS ---------------*/
@@ -45,12 +119,27 @@ uint8_t PPU::read(uint16_t addr)
             m_intRegs.w = 0;          // Side effect
             break;
         case 0x2004: // OAMDATA
-            return m_regs.OAMDATA;
+            return m_OAM[m_regs.OAMADDR];
             break;
         case 0x2007: // PPUDATA
-            // TODO: Implement the read buffer mechanism
-            return memory[m_intRegs.v.val];
+        {
+            uint16_t vramAddr = m_intRegs.v.val & 0x3FFF;
+            
+            if (vramAddr >= 0x3F00)
+            {
+                // Palette reads are immediate, but the buffer is filled with the nametable "underneath" the palette
+                readValue = memory[vramAddr];
+                m_readBuffer = memory[vramAddr - 0x1000];
+            }
+            else
+            {
+                readValue = m_readBuffer;
+                m_readBuffer = memory[vramAddr];
+            }
+            
+            incrementVRAMAddress();
             break;
+        }
         
         default:
             readValue = cpuDataBus;
@@ -62,8 +151,19 @@ uint8_t PPU::read(uint16_t addr)
 
 void PPU::write(uint16_t addr, uint8_t result)
 {
+    // Whether the write can move the background or sprite 0 (or hide either), changing where sprite 0 hits
+    bool movesSpriteZeroHit = true;
+    
     switch (addr) {
         case 0x2000: // PPUCTRL
+            // Sprite size and sprite pattern table change which pattern rows the sprite lines hold
+            if ((m_regs.PPUCTRL.val ^ result) & 0x28)
+                m_spriteLinesDirty = true;
+            
+            // Enabling NMI during vblank immediately triggers one
+            if (!m_regs.PPUCTRL.V && (result & 0x80) && m_regs.PPUSTATUS.V)
+                m_nmiPending = true;
+            
             m_regs.PPUCTRL.val = result;
             m_intRegs.t.nametable = (result & 0x03); // t: ...GH.. ........ <- d: ......GH
             break;
@@ -72,10 +172,13 @@ void PPU::write(uint16_t addr, uint8_t result)
             break;
         case 0x2003: // OAMADDR
             m_regs.OAMADDR = result;
+            movesSpriteZeroHit = false;
             break;
         case 0x2004: // OAMDATA
             m_regs.OAMDATA = result;
+            m_OAM[m_regs.OAMADDR] = result;
             m_regs.OAMADDR++;         // OAMADDR Increments after every write
+            m_spriteLinesDirty = true;
             break;
         case 0x2005: // PPUSCROLL
             writePPUScroll(result);
@@ -87,12 +190,28 @@ void PPU::write(uint16_t addr, uint8_t result)
             writePPUData(result);
             break;
         case 0x4014: // OAMDMA
-            // TODO -- Implement later
+            // Page data is supplied by the CPU memory through writeOAMDMA()
+            m_regs.OAMDMA = result;
             break;
-    
+        
         default:
+            movesSpriteZeroHit = false;
             break;
     }
+    
+    // NMI enable, or rendering being toggled (odd frame dot skip), moves the next events
+    postEvents();
+    
+    if (!movesSpriteZeroHit)
+        return;
+    
+    m_spriteZeroPredictionDirty = true;
+    
+    // The sprite 0 hit predicted at the start of the frame may no longer hold, so the rest of the frame is predicted
+    // again. Outside of the visible frame (e.g. VRAM updates during vblank), it has already fired, and the next frame
+    // is predicted when it starts.
+    if (m_scheduler && m_scanline < 240)
+        rescheduleSpriteZeroHit();
 }
 
 /* --------- WRITE HELPER FUNCTIONS --------- */
@@ -104,12 +223,12 @@ void PPU::writePPUScroll(uint8_t result)
     if (!m_intRegs.w) // m_intRegs.w == 0
     {
         m_intRegs.t.coarseX = (result >> 3);
-        m_intRegs.x = (result & 0x08);
+        m_intRegs.x = (result & 0x07);
     }
     else              // m_intRegs.w == 1
     {
         m_intRegs.t.coarseY = (result >> 3);
-        m_intRegs.t.fineY = (result & 0x08);
+        m_intRegs.t.fineY = (result & 0x07);
     }
     
     // Toggle after every write
@@ -140,6 +259,16 @@ void PPU::writePPUData(uint8_t result)
     m_regs.PPUDATA = result;
     memory[m_intRegs.v.val] = result;
     
+    // Writes to CHR RAM can change the pattern rows of sprites
+    if ((m_intRegs.v.val & 0x3FFF) < 0x2000)
+        m_spriteLinesDirty = true;
+    
+    stampVRAMWrite(m_intRegs.v.val);
+    incrementVRAMAddress();
+}
+
+void PPU::incrementVRAMAddress()
+{
     if (m_regs.PPUCTRL.I)
     {
         m_regs.PPUADDR.val += 0x20;
@@ -150,7 +279,40 @@ void PPU::writePPUData(uint8_t result)
         m_regs.PPUADDR.val++;
         m_intRegs.v.val++;
     }
+}
+
+void PPU::stampVRAMWrite(uint16_t addr)
+{
+    addr &= 0x3FFF;
+    m_vramWriteSeq++;
     
+    if (addr < 0x2000)
+    {
+        m_chrWrites[addr >> 4] = m_vramWriteSeq;
+    }
+    else if (addr < 0x3F00)
+    {
+        // Stamp every logical nametable address that mirrors onto the byte that was written
+        uint16_t physical = memory.mirroredAddress(0x2000 | (addr & 0x0FFF));
+        uint16_t offset = addr & 0x03FF;
+        
+        for (uint16_t nametable = 0x2000; nametable < 0x3000; nametable += 0x0400)
+        {
+            if (memory.mirroredAddress(nametable | offset) == physical)
+                m_nametableWrites[(nametable | offset) & 0x0FFF] = m_vramWriteSeq;
+        }
+    }
+}
+
+void PPU::writeOAMDMA(const std::array<uint8_t, 256>& page)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        m_OAM[static_cast<uint8_t>(m_regs.OAMADDR + i)] = page[i];
+    }
+    
+    m_spriteLinesDirty = true;
+    m_spriteZeroPredictionDirty = true;
 }
 
 /* ---------- Other Helper Functions ---------- */
@@ -170,7 +332,7 @@ void PPU::fineYIncrement()
     if (m_intRegs.v.coarseY == 29)
     {
         m_intRegs.v.coarseY = 0;    // Simulate overflow
-        m_intRegs.v.nametable ^= 1; // Toggle vertical nametable
+        m_intRegs.v.nametable ^= 2; // Toggle vertical nametable
     }
     else if (m_intRegs.v.coarseY == 31)
     {
@@ -182,16 +344,986 @@ void PPU::fineYIncrement()
     }
 }
 
+void PPU::coarseXIncrement()
+{
+    if (m_intRegs.v.coarseX == 31)
+    {
+        m_intRegs.v.coarseX = 0;    // Simulate overflow
+        m_intRegs.v.nametable ^= 1; // Toggle horizontal nametable
+    }
+    else
+    {
+        m_intRegs.v.coarseX++;
+    }
+}
+
+/* ---------- Rendering Functions ---------- */
+
+void PPU::renderScanline(int y)
+{
+    if (m_spriteLinesDirty)
+    {
+        evaluateSprites();
+    }
+    
+    // Sprite overflow is set while evaluating the sprites of the next line
+    if ((m_regs.PPUMASK.b || m_regs.PPUMASK.s) && m_spriteLines[y].overflow)
+    {
+        m_regs.PPUSTATUS.O = 1;
+    }
+    
+    const RasterLine& raster = recordRasterLine(y);
+    
+    const bool spriteZeroPossible = m_regs.PPUMASK.b && m_regs.PPUMASK.s && y > 0 && m_spriteLines[y - 1].hasSpriteZero;
+    
+    // Skipped or deferred frame: keep the side effects of the line, but compose no pixels
+    if (!m_renderingThisFrame || m_deferredRendering)
+    {
+        if (spriteZeroPossible && spriteZeroHitX(y, m_intRegs.v.val) >= 0)
+        {
+            m_regs.PPUSTATUS.S = 1;
+        }
+        
+        return;
+    }
+    
+    bool spriteZeroHit = false;
+    const bool changed = composeLine(y, raster, m_journal.palettes[raster.paletteIndex],
+                                     (y > 0) ? &m_spriteLines[y - 1] : nullptr, m_frame.scanline(y),
+                                     spriteZeroPossible ? &spriteZeroHit : nullptr);
+    
+    if (spriteZeroHit)
+    {
+        m_regs.PPUSTATUS.S = 1;
+    }
+    
+    // The frame gets numbered once its visible part is complete
+    if (changed)
+    {
+        m_frame.markLineChanged(y, m_frameCount + 1);
+    }
+}
+
+bool PPU::composeLine(int y, const RasterLine& raster, const std::array<uint8_t, 32>& paletteRAM,
+                      const ScanlineSprites* sprites, uint16_t* out, bool* spriteZeroHit)
+{
+    union Registers::CPUMapped::PPUMASK mask;
+    mask.val = raster.mask;
+    
+    // Emphasis bits sit above the 6 bit color index, greyscale only keeps the column of the palette
+    const uint16_t emphasis = static_cast<uint16_t>(raster.mask >> 5) << 6;
+    const uint8_t greyscaleMask = mask.g ? 0x30 : 0x3F;
+    
+    // Resolve the palette RAM once per line instead of once per pixel
+    std::array<uint16_t, 32> colors;
+    for (int i = 0; i < 32; ++i)
+    {
+        colors[i] = emphasis | (paletteRAM[i] & greyscaleMask);
+    }
+    
+    std::array<uint8_t, 256> bgLine {};
+    if (mask.b)
+    {
+        if (m_bgCacheEnabled)
+            updateBackgroundLine(y, raster, bgLine);
+        else
+            fetchBackgroundLine(raster, bgLine);
+    }
+    
+    std::array<uint8_t, 256> spriteLine {};
+    std::array<bool, 256> behindBg {};
+    std::array<bool, 256> spriteZero {};
+    
+    // Sprites on line 0 are never drawn, as no evaluation happens before it
+    if (mask.s && sprites && sprites->count > 0)
+    {
+        drawSprite(*sprites, raster.mask, spriteLine, behindBg, spriteZero);
+    }
+    
+    uint16_t changes = 0;
+    
+    for (int x = 0; x < 256; ++x)
+    {
+        uint8_t bg = bgLine[x];
+        uint8_t sprite = spriteLine[x];
+        
+        // Sprite 0 hit never happens at x = 255
+        if (spriteZeroHit && spriteZero[x] && bg && sprite && x != 255)
+        {
+            *spriteZeroHit = true;
+        }
+        
+        const uint16_t pixel = colors[(sprite && (!behindBg[x] || !bg)) ? sprite : bg];
+        changes |= out[x] ^ pixel;
+        out[x] = pixel;
+    }
+    
+    return changes != 0;
+}
+
+void PPU::renderJournal(const RasterJournal& journal, FrameBuffer& out)
+{
+    if (m_spriteLinesDirty)
+    {
+        evaluateSprites();
+    }
+    
+    ScanlineSprites evaluated;
+    
+    // Nothing was recorded yet
+    if (journal.palettes.empty())
+        return;
+    
+    for (int y = 0; y < 240; ++y)
+    {
+        const RasterLine& raster = journal.lines[y];
+        const ScanlineSprites* sprites = nullptr;
+        
+        // Like the live renderer, the sprites of a line follow the sprite bits of PPUCTRL on that line
+        if (y > 0)
+        {
+            if ((raster.control & 0x28) == m_spriteControl)
+            {
+                sprites = &m_spriteLines[y - 1];
+            }
+            else
+            {
+                evaluateSpriteLine(y - 1, raster.control, evaluated);
+                sprites = &evaluated;
+            }
+        }
+        
+        if (composeLine(y, raster, journal.palettes[raster.paletteIndex], sprites, out.scanline(y), nullptr))
+        {
+            out.markLineChanged(y, journal.frameNumber);
+        }
+    }
+    
+    out.frameNumber = journal.frameNumber;
+}
+
+void PPU::setDeferredRendering(bool deferred)
+{
+    m_deferredRendering = deferred;
+}
+
+bool PPU::isDeferredRendering() const
+{
+    return m_deferredRendering;
+}
+
+const RasterJournal& PPU::getRasterJournal() const
+{
+    return m_lastJournal;
+}
+
+RasterLine PPU::currentRaster() const
+{
+    RasterLine raster;
+    raster.v = m_intRegs.v.val;
+    raster.fineX = m_intRegs.x;
+    raster.control = m_regs.PPUCTRL.val;
+    raster.mask = m_regs.PPUMASK.val;
+    raster.paletteIndex = 0;
+    return raster;
+}
+
+const RasterLine& PPU::recordRasterLine(int y)
+{
+    RasterLine& raster = m_journal.lines[y];
+    raster = currentRaster();
+    
+    std::array<uint8_t, 32> paletteRAM;
+    for (int i = 0; i < 32; ++i)
+    {
+        paletteRAM[i] = memory[0x3F00 + i];
+    }
+    
+    // A new palette is only stored when it differs from the one of the previous line
+    if (y == 0 || m_journal.palettes.empty() || m_journal.palettes.back() != paletteRAM)
+    {
+        if (y == 0)
+            m_journal.palettes.clear();
+        
+        m_journal.palettes.push_back(paletteRAM);
+    }
+    
+    raster.paletteIndex = static_cast<uint8_t>(m_journal.palettes.size() - 1);
+    return raster;
+}
+
+void PPU::finishJournal()
+{
+    m_journal.frameNumber = m_frameCount;
+    
+    if (m_renderingThisFrame && m_deferredRendering)
+    {
+        renderJournal(m_journal, m_frame);
+    }
+    
+    // Swapping keeps the capacity of both palette lists, so recording never allocates once warmed up
+    std::swap(m_journal, m_lastJournal);
+}
+
+uint8_t PPU::fetchBackgroundTile(uint16_t v, uint16_t patternBase, uint8_t* out) const
+{
+    uint8_t tileIndex = memory[0x2000 | (v & 0x0FFF)];
+    uint8_t attribute = memory[0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)];
+    
+    // Select which 2x2 tile quadrant of the attribute byte this tile belongs to
+    uint8_t shift = ((v >> 4) & 0x04) | (v & 0x02);
+    uint8_t paletteBits = ((attribute >> shift) & 0x03) << 2;
+    
+    uint16_t patternAddr = patternBase + (tileIndex * 16) + ((v >> 12) & 0x07);
+    uint8_t lo = memory[patternAddr];
+    uint8_t hi = memory[patternAddr + 8];
+    
+    for (int bit = 7; bit >= 0; --bit)
+    {
+        uint8_t pixel = ((lo >> bit) & 0x01) | (((hi >> bit) & 0x01) << 1);
+        *out++ = pixel ? (paletteBits | pixel) : 0;
+    }
+    
+    return tileIndex;
+}
+
+void PPU::fetchBackgroundLine(const RasterLine& raster, std::array<uint8_t, 256>& bgLine) const
+{
+    uint16_t v = raster.v;
+    const uint16_t patternBase = (raster.control & 0x10) ? 0x1000 : 0x0000;
+    
+    // 33 tiles are needed to cover the screen whenever fine x is not 0
+    std::array<uint8_t, 33 * 8> tiles;
+    
+    for (int tile = 0; tile < 33; ++tile)
+    {
+        fetchBackgroundTile(v, patternBase, &tiles[tile * 8]);
+        
+        // Coarse X increment on a local copy of v
+        if ((v & 0x001F) == 31)
+        {
+            v &= ~0x001F;
+            v ^= 0x0400;
+        }
+        else
+        {
+            v++;
+        }
+    }
+    
+    // Start fine x pixels into the first tile, so it is partially scrolled off screen
+    std::copy(tiles.begin() + raster.fineX, tiles.begin() + raster.fineX + 256, bgLine.begin());
+    
+    // Hide the background in the leftmost 8 pixels
+    if (!(raster.mask & 0x02))
+    {
+        std::fill(bgLine.begin(), bgLine.begin() + 8, 0);
+    }
+}
+
+void PPU::updateBackgroundLine(int y, const RasterLine& raster, std::array<uint8_t, 256>& bgLine)
+{
+    BackgroundLineCache& cache = m_bgCache[y];
+    
+    uint16_t v = raster.v;
+    const uint16_t patternBase = (raster.control & 0x10) ? 0x1000 : 0x0000;
+    
+    // A different scroll or pattern table invalidates every tile of the line
+    const bool fullFetch = !cache.valid || cache.v != v || cache.patternBase != patternBase;
+    
+    for (int tile = 0; tile < 33; ++tile)
+    {
+        uint16_t nametableAddr = v & 0x0FFF;
+        uint16_t attributeAddr = 0x03C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
+        
+        bool stale = fullFetch ||
+                     m_nametableWrites[nametableAddr] > cache.fetchedAt ||
+                     m_nametableWrites[attributeAddr] > cache.fetchedAt ||
+                     m_chrWrites[(patternBase >> 4) + cache.tiles[tile]] > cache.fetchedAt;
+        
+        if (stale)
+        {
+            cache.tiles[tile] = fetchBackgroundTile(v, patternBase, &cache.pixels[tile * 8]);
+        }
+        
+        if ((v & 0x001F) == 31)
+        {
+            v &= ~0x001F;
+            v ^= 0x0400;
+        }
+        else
+        {
+            v++;
+        }
+    }
+    
+    cache.v = raster.v;
+    cache.patternBase = patternBase;
+    cache.fetchedAt = m_vramWriteSeq;
+    cache.valid = true;
+    
+    std::copy(cache.pixels.begin() + raster.fineX, cache.pixels.begin() + raster.fineX + 256, bgLine.begin());
+    
+    if (!(raster.mask & 0x02))
+    {
+        std::fill(bgLine.begin(), bgLine.begin() + 8, 0);
+    }
+}
+
+void PPU::setBackgroundCaching(bool enabled)
+{
+    m_bgCacheEnabled = enabled;
+    invalidateBackgroundCache();
+}
+
+void PPU::invalidateBackgroundCache()
+{
+    for (BackgroundLineCache& cache : m_bgCache)
+    {
+        cache.valid = false;
+    }
+}
+
+void PPU::evaluateSprites()
+{
+    for (int line = 0; line < 240; ++line)
+    {
+        evaluateSpriteLine(line, m_regs.PPUCTRL.val, m_spriteLines[line]);
+    }
+    
+    m_spriteControl = m_regs.PPUCTRL.val & 0x28;
+    m_spriteLinesDirty = false;
+}
+
+void PPU::evaluateSpriteLine(int line, uint8_t control, ScanlineSprites& evaluated) const
+{
+    const uint8_t height = (control & 0x20) ? 16 : 8;
+    
+    evaluated.count = 0;
+    evaluated.overflow = false;
+    evaluated.hasSpriteZero = false;
+    
+    int n = 0;
+    
+    // Copy the first 8 sprites in range into secondary OAM
+    for (; n < 64 && evaluated.count < 8; ++n)
+    {
+        const uint8_t* entry = &m_OAM[n * 4];
+        int row = line - entry[0];
+        
+        if (row < 0 || row >= height)
+            continue;
+        
+        const uint8_t tile = entry[1];
+        const uint8_t attributes = entry[2];
+        
+        if (attributes & 0x80) // Flip vertically
+            row = height - 1 - row;
+        
+        uint16_t patternAddr;
+        if (height == 16)
+        {
+            // 8x16 sprites take the pattern table from bit 0 of the tile, and use the next tile for the bottom half
+            patternAddr = ((tile & 0x01) ? 0x1000 : 0x0000) + ((tile & 0xFE) + (row >> 3)) * 16 + (row & 0x07);
+        }
+        else
+        {
+            patternAddr = ((control & 0x08) ? 0x1000 : 0x0000) + (tile * 16) + row;
+        }
+        
+        Sprite& sprite = evaluated.sprites[evaluated.count++];
+        sprite.x = entry[3];
+        sprite.attributes = attributes;
+        sprite.patternLo = memory[patternAddr];
+        sprite.patternHi = memory[patternAddr + 8];
+        sprite.paletteBase = 0x10 | ((attributes & 0x03) << 2);
+        sprite.behindBackground = attributes & 0x20;
+        sprite.isSpriteZero = (n == 0);
+        
+        if (attributes & 0x40) // Flip horizontally
+        {
+            sprite.patternLo = reverseBits(sprite.patternLo);
+            sprite.patternHi = reverseBits(sprite.patternHi);
+        }
+        
+        evaluated.hasSpriteZero |= sprite.isSpriteZero;
+    }
+    
+    /*
+     Once secondary OAM is full, the hardware keeps looking for a 9th sprite, but wrongly increments
+     the byte offset (m) alongside the sprite index (n) when a sprite is not in range. This makes it
+     treat tile, attribute, and x bytes as y coordinates, producing both false positives and negatives.
+     */
+    int m = 0;
+    for (; n < 64; ++n)
+    {
+        int row = line - m_OAM[n * 4 + m];
+        
+        if (row >= 0 && row < height)
+        {
+            evaluated.overflow = true;
+            break;
+        }
+        
+        m = (m + 1) & 0x03;
+    }
+}
+
+void PPU::drawSprite(const ScanlineSprites& evaluated, uint8_t mask, std::array<uint8_t, 256>& spriteLine,
+                     std::array<bool, 256>& behindBg, std::array<bool, 256>& spriteZero) const
+{
+    for (int i = 0; i < evaluated.count; ++i)
+    {
+        const Sprite& sprite = evaluated.sprites[i];
+        
+        for (int bit = 7, x = sprite.x; bit >= 0 && x < 256; --bit, ++x)
+        {
+            // Earlier sprites in OAM have priority over later ones, even when they are behind the background
+            if (spriteLine[x])
+                continue;
+            
+            uint8_t pixel = ((sprite.patternLo >> bit) & 0x01) | (((sprite.patternHi >> bit) & 0x01) << 1);
+            if (!pixel)
+                continue;
+            
+            spriteLine[x] = sprite.paletteBase | pixel;
+            behindBg[x] = sprite.behindBackground;
+            spriteZero[x] = sprite.isSpriteZero;
+        }
+    }
+    
+    // Hide sprites in the leftmost 8 pixels
+    if (!(mask & 0x04))
+    {
+        std::fill(spriteLine.begin(), spriteLine.begin() + 8, 0);
+    }
+}
+
+/* ---------- Timing Functions ---------- */
+
+void PPU::step(int dots)
+{
+    withRegionTiming(m_region, [this, dots](auto timing) { runDots<decltype(timing)>(dots); });
+}
+
+void PPU::setRegion(Region region)
+{
+    m_region = region;
+    postEvents();
+}
+
+Region PPU::getRegion() const
+{
+    return m_region;
+}
+
+template <typename Timing>
+void PPU::runDots(int dots)
+{
+    static_assert(Timing::DOTS_PER_SCANLINE == DOTS_PER_SCANLINE);
+    
+    while (dots > 0)
+    {
+        const bool renderingEnabled = m_regs.PPUMASK.b || m_regs.PPUMASK.s;
+        
+        // The last dot of the pre-render scanline is skipped on odd frames when rendering
+        const int lineLength = (Timing::SKIPS_ODD_FRAME_DOT && m_scanline == Timing::PRE_RENDER_SCANLINE &&
+                                m_oddFrame && renderingEnabled) ?
+                                DOTS_PER_SCANLINE - 1 : DOTS_PER_SCANLINE;
+        
+        const int from = m_dot;
+        const int advance = std::min(dots, lineLength - m_dot);
+        m_dot += advance;
+        m_dotCount += advance;
+        dots -= advance;
+        
+        // Dot d has been executed once m_dot goes from at most d to past d
+        auto crossed = [from, this](int d) { return from <= d && m_dot > d; };
+        
+        if (m_scanline < 240)
+        {
+            if (crossed(256))
+            {
+                renderScanline(m_scanline);
+                
+                if (renderingEnabled)
+                    fineYIncrement();
+            }
+            
+            // Horizontal bits of t are copied into v
+            if (renderingEnabled && crossed(257))
+                m_intRegs.v.val = (m_intRegs.v.val & 0x7BE0) | (m_intRegs.t.val & 0x041F);
+        }
+        else if (m_scanline == Timing::VBLANK_SCANLINE)
+        {
+            if (crossed(1))
+            {
+                m_regs.PPUSTATUS.V = 1;
+                
+                if (m_regs.PPUCTRL.V)
+                    m_nmiPending = true;
+            }
+        }
+        else if (m_scanline == Timing::PRE_RENDER_SCANLINE)
+        {
+            if (crossed(1))
+            {
+                m_regs.PPUSTATUS.V = 0;
+                m_regs.PPUSTATUS.S = 0;
+                m_regs.PPUSTATUS.O = 0;
+            }
+            
+            if (renderingEnabled && crossed(257))
+                m_intRegs.v.val = (m_intRegs.v.val & 0x7BE0) | (m_intRegs.t.val & 0x041F);
+            
+            // Vertical bits of t are copied into v (dots 280-304)
+            if (renderingEnabled && crossed(304))
+                m_intRegs.v.val = (m_intRegs.v.val & 0x041F) | (m_intRegs.t.val & 0x7BE0);
+        }
+        
+        if (m_dot == lineLength)
+        {
+            m_dot = 0;
+            nextScanline<Timing>();
+        }
+    }
+    
+    // A sprite 0 hit earlier on the current line is visible right away, not only once the line is rendered
+    if (m_scanline > 0 && m_scanline < 240 && m_dot <= 256 && !m_regs.PPUSTATUS.S &&
+        m_regs.PPUMASK.b && m_regs.PPUMASK.s)
+    {
+        if (m_spriteLinesDirty)
+        {
+            evaluateSprites();
+        }
+        
+        if (m_spriteLines[m_scanline - 1].hasSpriteZero)
+        {
+            int x = spriteZeroHitX(m_scanline, m_intRegs.v.val);
+            
+            // Pixel x is outputted on dot x + 1
+            if (x >= 0 && m_dot > x + 1)
+                m_regs.PPUSTATUS.S = 1;
+        }
+    }
+    
+    postEvents();
+}
+
+void PPU::catchUp(uint64_t dot)
+{
+    if (dot > m_dotCount)
+    {
+        step(static_cast<int>(dot - m_dotCount));
+    }
+}
+
+void PPU::setScheduler(Scheduler* scheduler)
+{
+    m_scheduler = scheduler;
+    postEvents();
+}
+
+void PPU::postEvents()
+{
+    if (!m_scheduler)
+        return;
+    
+    withRegionTiming(m_region, [this](auto timing)
+    {
+        using Timing = decltype(timing);
+        
+        // Vblank is set once dot 1 of the vblank scanline has been executed
+        if (m_nmiPending)
+            m_scheduler->schedule(EventType::NMI, m_dotCount);
+        else if (m_regs.PPUCTRL.V)
+            m_scheduler->schedule(EventType::NMI, m_dotCount + dotsUntil<Timing>(Timing::VBLANK_SCANLINE, 2));
+        else
+            m_scheduler->cancel(EventType::NMI);
+        
+        // The post-render scanline starts the moment the visible frame is complete
+        m_scheduler->schedule(EventType::FRAME_END, m_dotCount + dotsUntil<Timing>(240, 0));
+    });
+}
+
+template <typename Timing>
+int PPU::dotsUntil(int scanline, int dot) const
+{
+    const int current = (m_scanline * DOTS_PER_SCANLINE) + m_dot;
+    const int target = (scanline * DOTS_PER_SCANLINE) + dot;
+    
+    if (target > current)
+        return target - current;
+    
+    // Wrap around through the pre-render scanline, which is a dot shorter on odd frames when rendering
+    const bool skipsDot = Timing::SKIPS_ODD_FRAME_DOT && m_oddFrame && (m_regs.PPUMASK.b || m_regs.PPUMASK.s) &&
+                          current < (Timing::PRE_RENDER_SCANLINE * DOTS_PER_SCANLINE) + DOTS_PER_SCANLINE - 1;
+    
+    return (Timing::SCANLINES_PER_FRAME * DOTS_PER_SCANLINE) - current + target - (skipsDot ? 1 : 0);
+}
+
+template <typename Timing>
+void PPU::nextScanline()
+{
+    m_scanline++;
+    
+    if (m_scanline == 240)
+    {
+        // Post-render scanline: the visible part of the frame is complete
+        m_frameCount++;
+        m_frameEnded = true;
+        
+        if (m_renderingThisFrame)
+            m_frame.frameNumber = m_frameCount;
+        
+        finishJournal();
+    }
+    else if (m_scanline == Timing::SCANLINES_PER_FRAME)
+    {
+        m_scanline = 0;
+        m_oddFrame = !m_oddFrame;
+        
+        // Whether this frame gets its pixels composed is decided once, before its first line
+        m_renderingThisFrame = m_renderNextFrame;
+        
+        if (m_scheduler)
+        {
+            int32_t hitDot = getSpriteZeroHitDot();
+            
+            // The flag is visible once the dot of the hit has been executed
+            if (hitDot != NO_SPRITE_ZERO_HIT)
+                m_scheduler->schedule(EventType::SPRITE_ZERO_HIT, m_dotCount + hitDot + 1);
+            else
+                m_scheduler->cancel(EventType::SPRITE_ZERO_HIT);
+        }
+    }
+}
+
+bool PPU::pollNMI()
+{
+    bool nmi = m_nmiPending;
+    m_nmiPending = false;
+    
+    if (nmi)
+        postEvents();
+    
+    return nmi;
+}
+
+bool PPU::pollFrameEnd()
+{
+    bool ended = m_frameEnded;
+    m_frameEnded = false;
+    
+    return ended;
+}
+
+void PPU::setFrameRendering(bool render)
+{
+    m_renderNextFrame = render;
+}
+
+bool PPU::isRenderingFrame() const
+{
+    return m_renderingThisFrame;
+}
+
+uint64_t PPU::getFrameCount() const
+{
+    return m_frameCount;
+}
+
+uint64_t PPU::getDotCount() const
+{
+    return m_dotCount;
+}
+
+void PPU::saveState(PPUState& state) const
+{
+    state.regs = m_regs;
+    state.intRegs = m_intRegs;
+    state.cpuDataBus = cpuDataBus;
+    state.readBuffer = m_readBuffer;
+    
+    state.OAM = m_OAM;
+    state.spriteLines = m_spriteLines;
+    state.spriteLinesDirty = m_spriteLinesDirty;
+    state.spriteControl = m_spriteControl;
+    state.spriteZeroHitDot = m_spriteZeroHitDot;
+    state.spriteZeroPredictionDirty = m_spriteZeroPredictionDirty;
+    
+    state.scanline = m_scanline;
+    state.dot = m_dot;
+    state.oddFrame = m_oddFrame;
+    state.nmiPending = m_nmiPending;
+    state.frameEnded = m_frameEnded;
+    state.frameCount = m_frameCount;
+    state.dotCount = m_dotCount;
+    state.renderNextFrame = m_renderNextFrame;
+    state.renderingThisFrame = m_renderingThisFrame;
+    
+    state.bgCache = m_bgCache;
+    state.nametableWrites = m_nametableWrites;
+    state.chrWrites = m_chrWrites;
+    state.vramWriteSeq = m_vramWriteSeq;
+    
+    // Vector assignment reuses the snapshot's storage, so repeated snapshots don't allocate
+    state.journal = m_journal;
+    state.lastJournal = m_lastJournal;
+}
+
+void PPU::loadState(const PPUState& state)
+{
+    m_regs = state.regs;
+    m_intRegs = state.intRegs;
+    cpuDataBus = state.cpuDataBus;
+    m_readBuffer = state.readBuffer;
+    
+    m_OAM = state.OAM;
+    m_spriteLines = state.spriteLines;
+    m_spriteLinesDirty = state.spriteLinesDirty;
+    m_spriteControl = state.spriteControl;
+    m_spriteZeroHitDot = state.spriteZeroHitDot;
+    m_spriteZeroPredictionDirty = state.spriteZeroPredictionDirty;
+    
+    m_scanline = state.scanline;
+    m_dot = state.dot;
+    m_oddFrame = state.oddFrame;
+    m_nmiPending = state.nmiPending;
+    m_frameEnded = state.frameEnded;
+    m_frameCount = state.frameCount;
+    m_dotCount = state.dotCount;
+    m_renderNextFrame = state.renderNextFrame;
+    m_renderingThisFrame = state.renderingThisFrame;
+    
+    m_bgCache = state.bgCache;
+    m_nametableWrites = state.nametableWrites;
+    m_chrWrites = state.chrWrites;
+    m_vramWriteSeq = state.vramWriteSeq;
+    
+    m_journal = state.journal;
+    m_lastJournal = state.lastJournal;
+}
+
+const FrameBuffer& PPU::getFrame() const
+{
+    return m_frame;
+}
+
+/* ---------- Sprite 0 Hit Prediction ---------- */
+
+int PPU::spriteZeroHitX(int y, uint16_t v) const
+{
+    const Sprite& sprite = m_spriteLines[y - 1].sprites[0];
+    const uint8_t spriteOpaque = sprite.patternLo | sprite.patternHi;
+    const uint16_t patternBase = m_regs.PPUCTRL.B ? 0x1000 : 0x0000;
+    const bool leftClipped = !m_regs.PPUMASK.m || !m_regs.PPUMASK.M;
+    
+    for (int bit = 7, x = sprite.x; bit >= 0 && x < 255; --bit, ++x)
+    {
+        if (!((spriteOpaque >> bit) & 0x01) || (leftClipped && x < 8))
+            continue;
+        
+        // Locate the background tile under this pixel, wrapping into the next horizontal nametable
+        int scrolledX = x + m_intRegs.x;
+        uint16_t tileV = v;
+        int coarseX = (v & 0x001F) + (scrolledX >> 3);
+        if (coarseX >= 32)
+        {
+            tileV ^= 0x0400;
+            coarseX -= 32;
+        }
+        tileV = (tileV & ~0x001F) | coarseX;
+        
+        uint8_t tileIndex = memory[0x2000 | (tileV & 0x0FFF)];
+        uint16_t patternAddr = patternBase + (tileIndex * 16) + ((v >> 12) & 0x07);
+        uint8_t bgOpaque = memory[patternAddr] | memory[patternAddr + 8];
+        
+        if ((bgOpaque >> (7 - (scrolledX & 0x07))) & 0x01)
+            return x;
+    }
+    
+    return -1;
+}
+
+int32_t PPU::predictSpriteZeroHit(int fromScanline, uint16_t v)
+{
+    // Sprite 0 hit requires both layers to be rendered
+    if (!m_regs.PPUMASK.b || !m_regs.PPUMASK.s)
+        return NO_SPRITE_ZERO_HIT;
+    
+    if (m_spriteLinesDirty)
+    {
+        evaluateSprites();
+    }
+    
+    for (int y = fromScanline; y < 240; ++y)
+    {
+        // Horizontal bits of t are copied into v at the start of every line
+        v = (v & 0x7BE0) | (m_intRegs.t.val & 0x041F);
+        
+        // Sprite 0 is always the first sprite of the line when it is present
+        if (y > 0 && m_spriteLines[y - 1].hasSpriteZero)
+        {
+            int x = spriteZeroHitX(y, v);
+            
+            // Pixel x is outputted on dot x + 1
+            if (x >= 0)
+                return (y * DOTS_PER_SCANLINE) + x + 1;
+        }
+        
+        v = fineYIncremented(v);
+    }
+    
+    return NO_SPRITE_ZERO_HIT;
+}
+
+int32_t PPU::getSpriteZeroHitDot()
+{
+    if (m_spriteZeroPredictionDirty)
+    {
+        // The frame starts with the vertical bits of t copied into v during the pre-render scanline
+        uint16_t v = (m_intRegs.v.val & 0x041F) | (m_intRegs.t.val & 0x7BE0);
+        
+        m_spriteZeroHitDot = predictSpriteZeroHit(0, v);
+        m_spriteZeroPredictionDirty = false;
+    }
+    
+    return m_spriteZeroHitDot;
+}
+
+void PPU::rescheduleSpriteZeroHit()
+{
+    // The flag stays set until the pre-render scanline once the hit happened
+    int32_t hitDot = NO_SPRITE_ZERO_HIT;
+    
+    if (!m_regs.PPUSTATUS.S)
+    {
+        // A hit later on the current line is caught by the check at the end of step(), so prediction starts on the
+        // next line, with v as it will be once the current line has been rendered
+        uint16_t v = m_intRegs.v.val;
+        if (m_dot <= 256 && (m_regs.PPUMASK.b || m_regs.PPUMASK.s))
+            v = fineYIncremented(v);
+        
+        hitDot = predictSpriteZeroHit(m_scanline + 1, v);
+    }
+    
+    if (hitDot != NO_SPRITE_ZERO_HIT)
+    {
+        const uint64_t frameStart = m_dotCount - (static_cast<uint64_t>(m_scanline) * DOTS_PER_SCANLINE + m_dot);
+        m_scheduler->schedule(EventType::SPRITE_ZERO_HIT, frameStart + hitDot + 1);
+    }
+    else
+    {
+        m_scheduler->cancel(EventType::SPRITE_ZERO_HIT);
+    }
+}
+
+/* ---------- Debug Functions ---------- */
+
 void PPU::updateScreen() const
 {
-    // Draw each tile individually
-    for (int m = 0; m < 32; ++m)
+    // Only place where the indexed frame gets expanded into RGBA
+    if (sink)
     {
-        for (int n = 0; n < 30; ++n)
+        sink->presentFrame(m_frame, palette);
+    }
+}
+
+bool PPU::verifySpriteZeroPrediction()
+{
+    int32_t predicted = getSpriteZeroHitDot();
+    int32_t actual = NO_SPRITE_ZERO_HIT;
+    
+    if (m_spriteLinesDirty)
+    {
+        evaluateSprites();
+    }
+    
+    // Walk the frame exactly like step() does, but on a copy of v so no state is disturbed
+    auto savedV = m_intRegs.v;
+    m_intRegs.v.val = (m_intRegs.v.val & 0x041F) | (m_intRegs.t.val & 0x7BE0);
+    
+    for (int y = 0; y < 240 && actual == NO_SPRITE_ZERO_HIT; ++y)
+    {
+        m_intRegs.v.val = (m_intRegs.v.val & 0x7BE0) | (m_intRegs.t.val & 0x041F);
+        
+        std::array<uint8_t, 256> bgLine {};
+        std::array<uint8_t, 256> spriteLine {};
+        std::array<bool, 256> behindBg {};
+        std::array<bool, 256> spriteZero {};
+        
+        if (m_regs.PPUMASK.b && m_regs.PPUMASK.s && y > 0)
         {
-            uint8_t tile = memory[0x2000 + ]
+            fetchBackgroundLine(currentRaster(), bgLine);
+            drawSprite(m_spriteLines[y - 1], m_regs.PPUMASK.val, spriteLine, behindBg, spriteZero);
         }
+        
+        for (int x = 0; x < 255; ++x)
+        {
+            if (spriteZero[x] && bgLine[x] && spriteLine[x])
+            {
+                actual = (y * DOTS_PER_SCANLINE) + x + 1;
+                break;
+            }
+        }
+        
+        fineYIncrement();
     }
+    
+    m_intRegs.v = savedV;
+    
+    return predicted == actual;
+}
+
+const Memory& PPU::getMemory() const
+{
+    return memory;
+}
+
+const Palette& PPU::getPalette() const
+{
+    return palette;
+}
+
+void PPU::setPalette(const Palette& newPalette)
+{
+    palette = newPalette;
+}
+
+const std::array<uint8_t, 256>& PPU::getOAM() const
+{
+    return m_OAM;
+}
+
+uint8_t PPU::getControl() const
+{
+    return m_regs.PPUCTRL.val;
+}
+
+uint16_t PPU::getTempAddress() const
+{
+    return m_intRegs.t.val;
+}
+
+uint8_t PPU::getFineX() const
+{
+    return m_intRegs.x;
+}
+
+uint64_t PPU::getVRAMWriteSeq() const
+{
+    return m_vramWriteSeq;
+}
+
+const std::array<uint64_t, 0x1000>& PPU::getNametableWrites() const
+{
+    return m_nametableWrites;
+}
+
+const std::array<uint64_t, 512>& PPU::getCHRWrites() const
+{
+    return m_chrWrites;
 }
 
 void PPU::debug() const
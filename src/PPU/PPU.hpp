@@ -11,11 +11,15 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <array>
+#include <vector>
 
 // LIB includes
 #include "../util/ppumem.hpp"
 #include "palette.hpp"
-#include "../screen/gui.hpp"
+#include "framebuffer.hpp"
+#include "../screen/videosink.hpp"
+#include "../util/scheduler.hpp"
+#include "../util/region.hpp"
 
 namespace Registers
 {
@@ -102,13 +106,115 @@ struct Internal
 
 } // namespace Registers
 
-struct Sprite 
+/*
+ Sprite decoded from primary OAM for a single scanline
+ 
+ Everything the compositor needs is resolved ahead of time, so drawing a line never touches OAM or CHR memory
+ */
+struct Sprite
+{
+    uint8_t x;              // X position of the left side of the sprite
+    uint8_t attributes;     // Raw attribute byte (palette, priority, flip)
+    uint8_t patternLo;      // Pattern row of the scanline, already flipped so bit 7 is always the leftmost pixel
+    uint8_t patternHi;
+    uint8_t paletteBase;    // Palette entry of the sprite (0x10 | palette << 2)
+    bool behindBackground;  // Priority (0: in front of background, 1: behind background)
+    bool isSpriteZero;      // Whether this sprite is OAM entry 0
+};
+
+/*
+ Result of the sprite evaluation of a single scanline (at most 8 sprites, in OAM order)
+ */
+struct ScanlineSprites
+{
+    std::array<Sprite, 8> sprites;
+    uint8_t count;
+    bool overflow;          // Sprite overflow flag, including the hardware's diagonal OAM evaluation bug
+    bool hasSpriteZero;     // Whether sprite 0 is part of this line
+};
+
+/*
+ Background pixels of one scanline as fetched on a previous frame, kept to avoid refetching unchanged tiles
+ */
+struct BackgroundLineCache
+{
+    std::array<uint8_t, 33 * 8> pixels; // 33 tiles worth of palette entries, not yet shifted by fine x
+    std::array<uint8_t, 33> tiles;      // Tile index fetched for each of the 33 tiles
+    uint16_t v;                         // Internal register v the line was fetched with
+    uint16_t patternBase;               // Background pattern table the line was fetched with
+    uint64_t fetchedAt;                 // VRAM write sequence the line is up to date with
+    bool valid;
+};
+
+/*
+ Registers in effect on one visible scanline, as latched when the line is rendered (dot 256)
+ */
+struct RasterLine
+{
+    uint16_t v;             // Internal register v, with the horizontal bits already copied from t
+    uint8_t fineX;
+    uint8_t control;        // PPUCTRL
+    uint8_t mask;           // PPUMASK
+    uint8_t paletteIndex;   // Palette RAM contents, as an index into RasterJournal::palettes
+};
+
+/*
+ Raster effect journal of one frame: the scroll, PPUCTRL, PPUMASK, and palette of each of the 240 visible lines
+ 
+ Palette RAM rarely changes mid frame, so each distinct palette is only stored once. Together with VRAM and OAM,
+ a journal is all that is needed to compose the frame, so frames can be rendered in one batch once the CPU is
+ done with them, or rendered again later (e.g. for screenshots or video).
+ */
+struct RasterJournal
 {
+    std::array<RasterLine, 240> lines {};
+    std::vector<std::array<uint8_t, 32>> palettes;
+    uint64_t frameNumber = 0;   // Frame count of the PPU when the frame was completed (0 if none was yet)
+};
+
+/*
+ Everything the PPU needs to resume emulation from a point in time (see PPU::saveState)
+ 
+ VRAM lives in the PPU's memory and is saved along with it. The caches (evaluated sprites, background lines and
+ their write stamps) are kept too: they are only valid for the VRAM and OAM they were built from, and copying them
+ is cheaper than rebuilding them after every restore. The whole struct is about 150 KB, so keep it on the heap.
+ */
+struct PPUState
+{
+    struct Registers::CPUMapped regs;
+    struct Registers::Internal intRegs;
+    uint8_t cpuDataBus;
+    uint8_t readBuffer;
+    
+    std::array<uint8_t, 256> OAM;
+    std::array<ScanlineSprites, 240> spriteLines;
+    bool spriteLinesDirty;
+    uint8_t spriteControl;
+    int32_t spriteZeroHitDot;
+    bool spriteZeroPredictionDirty;
+    
+    int scanline;
+    int dot;
+    bool oddFrame;
+    bool nmiPending;
+    bool frameEnded;
+    uint64_t frameCount;
+    uint64_t dotCount;
+    bool renderNextFrame;
+    bool renderingThisFrame;
+    
+    std::array<BackgroundLineCache, 240> bgCache;
+    std::array<uint64_t, 0x1000> nametableWrites;
+    std::array<uint64_t, 512> chrWrites;
+    uint64_t vramWriteSeq;
     
+    RasterJournal journal;
+    RasterJournal lastJournal;
 };
 
 class PPU
 {
+protected:
     // Internal color palette
     Palette palette;
     
@@ -116,17 +222,82 @@ class PPU
     struct Registers::CPUMapped m_regs; // Completely remove this later
     struct Registers::Internal m_intRegs;
     
-    // Include reference to GUI for rendering
-    GUI* gui;
+    // Where finished frames are presented (window, memory, or nowhere)
+    VideoSink* sink;
     
     Memory& memory;
     
+    // Indexed output of the PPU, only converted to RGBA when presented
+    FrameBuffer m_frame;
+    
+    // Primary OAM (64 sprites, 4 bytes each)
+    std::array<uint8_t, 256> m_OAM;
+    
+    /*
+     Sprites evaluated on each visible scanline, which are drawn on the following scanline.
+     Rebuilt from OAM only when OAM, the sprite pattern tables, or the sprite size/table select change.
+     */
+    std::array<ScanlineSprites, 240> m_spriteLines;
+    bool m_spriteLinesDirty;
+    uint8_t m_spriteControl;    // Sprite size and sprite pattern table bits of PPUCTRL the lines were evaluated with
+    
+    // Predicted dot of the next sprite 0 hit (see predictSpriteZeroHit), recomputed lazily when dirty
+    int32_t m_spriteZeroHitDot;
+    bool m_spriteZeroPredictionDirty;
+    
+    // Timing state
+    Region m_region;            // Picks the timing constants step() is instantiated with
+    int m_scanline;             // 0-239: Visible, 240: Post-render, then vblank, and the pre-render line last
+    int m_dot;                  // Dots already executed on the current scanline
+    bool m_oddFrame;
+    bool m_nmiPending;          // NMI raised by the PPU, waiting to be picked up by the CPU
+    bool m_frameEnded;          // Visible frame completed, waiting to be picked up by the console
+    uint64_t m_frameCount;      // Frames completed (rendered or skipped)
+    uint64_t m_dotCount;        // Dots executed since power up
+    
+    // Scheduler the PPU posts its events to (optional)
+    Scheduler* m_scheduler;
+    
+    // Internal buffer returned by PPUDATA reads (reads outside of the palette are delayed by one read)
+    uint8_t m_readBuffer;
+    
+    // Frame skipping: requested for the next frame, and latched for the current one
+    bool m_renderNextFrame;
+    bool m_renderingThisFrame;
+    
+    /*
+     Incremental background rendering
+     
+     Every PPUDATA write bumps m_vramWriteSeq and stamps the nametable byte (by logical address, so all of its
+     mirrors) or CHR tile it touched. A cached line only refetches the tiles stamped after it was fetched,
+     and is refetched entirely when its scroll (v, fine y) or background pattern table differ.
+     */
+    std::array<BackgroundLineCache, 240> m_bgCache;
+    std::array<uint64_t, 0x1000> m_nametableWrites; // $2000-$2FFF
+    std::array<uint64_t, 512> m_chrWrites;          // $0000-$1FFF, per 16 byte tile
+    uint64_t m_vramWriteSeq;
+    bool m_bgCacheEnabled;
+    
+    // Raster journal of the frame being rendered, and of the last completed frame
+    RasterJournal m_journal;
+    RasterJournal m_lastJournal;
+    
+    // Pixels are composed from the journal once the visible frame is complete, instead of line by line
+    bool m_deferredRendering;
+
 public:
+    // Scanline length of every region (frame length and vblank position come from the region timing structs)
+    static constexpr int DOTS_PER_SCANLINE = 341;
+    
+    // Returned by the sprite 0 hit prediction when no hit will happen this frame
+    static constexpr int32_t NO_SPRITE_ZERO_HIT = -1;
+    
     // Used to talk between CPU and PPU
     uint8_t cpuDataBus;
     
     //Constructors Destructors
-    PPU(Memory& mem, GUI* gui);
+    PPU(Memory& mem, VideoSink* sink);
+    virtual ~PPU() = default;
     
     /*
      Power/Reset function for PPU
@@ -139,14 +310,27 @@ public:
     const uint8_t& operator[](uint16_t address) const;
     
     //PPU Memory read/write functions
-    uint8_t read(uint16_t addr);
-    void write(uint16_t addr, uint8_t result);
+    virtual uint8_t read(uint16_t addr);
+    virtual void write(uint16_t addr, uint8_t result);
     
     // Write helper functions
     void writePPUScroll(uint8_t result);
     void writePPUAddr(uint8_t result);
     void writePPUData(uint8_t result);
     
+    // Increments internal register v by 1 or 32 (PPUCTRL.I) after a PPUDATA access
+    void incrementVRAMAddress();
+    
+    // Marks the nametable byte or CHR tile at addr as written, for the incremental background renderer
+    void stampVRAMWrite(uint16_t addr);
+    
+    /**
+     *  Copies a full page of CPU memory into OAM, starting at OAMADDR (wrapping around like the hardware)
+     *
+     *  @param page The 256 bytes read from $XX00-$XXFF, where XX is the value written to $4014
+     */
+    virtual void writeOAMDMA(const std::array<uint8_t, 256>& page);
+    
     // Other helper functions
     
     /**
@@ -158,13 +342,272 @@ public:
      */
     void fineYIncrement();
     
+    /**
+     *  Increments coarse X of internal register v. When coarse X overflows past 31, it wraps to 0 and
+     *  the horizontal nametable (bit 10 of internal register v) is toggled.
+     */
+    void coarseXIncrement();
+    
     /* ----- RENDERING FUNCTIONS ----- */
-    void drawSprite() const;
-    void drawScreen() const;
+    
+    /**
+     *  Renders one visible scanline into the indexed frame buffer, using the current state of internal register v.
+     *  The registers of the line are recorded into the raster journal, whether the line is composed or not.
+     *
+     *  @param y Scanline to render (0-239)
+     */
+    void renderScanline(int y);
+    
+    /**
+     *  Composes the pixels of one scanline from the registers of a raster line
+     *
+     *  @param y Scanline to compose (0-239)
+     *  @param raster Registers of the line
+     *  @param paletteRAM Palette RAM of the line ($3F00-$3F1F)
+     *  @param sprites Sprites evaluated for the line (nullptr on line 0, which never has sprites)
+     *  @param out Output indexed pixels
+     *  @param spriteZeroHit Set to true if sprite 0 hits the background on this line (nullptr to skip the check)
+     *  @return True if any pixel of out changed
+     */
+    bool composeLine(int y, const RasterLine& raster, const std::array<uint8_t, 32>& paletteRAM,
+                     const ScanlineSprites* sprites, uint16_t* out, bool* spriteZeroHit);
+    
+    /**
+     *  Composes a whole frame from a raster journal, with the current VRAM and OAM contents. Gives the same frame
+     *  the PPU rendered line by line, as long as VRAM and OAM were not changed since (e.g. right at the end of
+     *  the visible frame).
+     *
+     *  @param journal Registers of every line of the frame
+     *  @param out Frame to render into (takes the frame number of the journal, which also stamps the lines that changed)
+     */
+    void renderJournal(const RasterJournal& journal, FrameBuffer& out);
+    
+    /**
+     *  Renders every frame in one batch from its raster journal as soon as its visible part is complete, instead of
+     *  composing each line while the CPU runs. Side effects (sprite 0 hit, sprite overflow) are still exact.
+     *  Mid frame writes to VRAM or OAM are not seen by the batch (only scroll, PPUCTRL, PPUMASK, and palette changes).
+     */
+    void setDeferredRendering(bool deferred);
+    bool isDeferredRendering() const;
+    
+    // Raster journal of the last completed frame
+    const RasterJournal& getRasterJournal() const;
+    
+    // Registers currently in effect, as a raster line (the palette index is left at 0)
+    RasterLine currentRaster() const;
+    
+    /**
+     *  Fetches the 256 background pixels of a scanline starting from internal register v and fine x of a raster line.
+     *  Each pixel is a 4 bit palette entry (0 when transparent), ready to be looked up at $3F00.
+     */
+    void fetchBackgroundLine(const RasterLine& raster, std::array<uint8_t, 256>& bgLine) const;
+    
+    /**
+     *  Fetches the 8 background pixels of a single tile (not shifted by fine x)
+     *
+     *  @param v Internal register v pointing at the tile
+     *  @param patternBase Background pattern table address ($0000 or $1000)
+     *  @param out Output palette entries (0 when transparent)
+     *  @return Tile index read from the nametable
+     */
+    uint8_t fetchBackgroundTile(uint16_t v, uint16_t patternBase, uint8_t* out) const;
+    
+    /**
+     *  Same output as fetchBackgroundLine(), but only refetches the tiles of scanline y whose nametable, attribute,
+     *  or pattern bytes were written since the line was last fetched. Falls back to a full fetch of the line when
+     *  the scroll or background pattern table changed.
+     */
+    void updateBackgroundLine(int y, const RasterLine& raster, std::array<uint8_t, 256>& bgLine);
+    
+    // Enables/disables reusing background tiles from the previous frame (enabled by default)
+    void setBackgroundCaching(bool enabled);
+    
+    // Forgets every cached background line. Must be called after VRAM is modified without going through PPUDATA
+    void invalidateBackgroundCache();
+    
+    /**
+     *  Decodes primary OAM into m_spriteLines. Each of the 240 evaluation lines gets up to 8 sprites with their
+     *  pattern rows prefetched, along with the overflow and sprite 0 flags the hardware would produce.
+     */
+    void evaluateSprites();
+    
+    /**
+     *  Evaluates the sprites of a single line from primary OAM
+     *
+     *  @param line Evaluation line (the sprites are drawn on line + 1)
+     *  @param control PPUCTRL to take the sprite size and sprite pattern table from
+     *  @param evaluated Output sprites of the line
+     */
+    void evaluateSpriteLine(int line, uint8_t control, ScanlineSprites& evaluated) const;
+    
+    /**
+     *  Draws the sprites evaluated for a scanline into spriteLine. Each pixel is a palette entry (0x10-0x1F, 0 when transparent).
+     *  Only the sprites evaluated for this line are visited.
+     *
+     *  @param evaluated Sprites of the scanline (evaluated on the previous line)
+     *  @param mask PPUMASK of the scanline
+     *  @param spriteLine Output palette entries
+     *  @param behindBg Output priority bit of the sprite drawn at each pixel
+     *  @param spriteZero Output whether the pixel drawn came from sprite 0
+     */
+    void drawSprite(const ScanlineSprites& evaluated, uint8_t mask, std::array<uint8_t, 256>& spriteLine,
+                    std::array<bool, 256>& behindBg, std::array<bool, 256>& spriteZero) const;
+    
+    // Get the most recently rendered (indexed) frame
+    virtual const FrameBuffer& getFrame() const;
+    
+    /* ----- TIMING FUNCTIONS ----- */
+    
+    /**
+     *  Runs the PPU for a number of dots (3 per CPU cycle on NTSC). Visible scanlines are rendered once
+     *  dot 256 is reached, and vblank / NMI / flag clearing happen on dot 1 of their scanlines.
+     *  Dispatches once to the instantiation of runDots() matching the region.
+     *
+     *  @param dots Number of dots to run for
+     */
+    virtual void step(int dots);
+    
+    /**
+     *  Sets the region whose frame timing the PPU follows (NTSC by default). Must be called before the PPU starts running.
+     */
+    virtual void setRegion(Region region);
+    Region getRegion() const;
+    
+    /**
+     *  Catch-up synchronization: runs the PPU up to a dot of the master clock. Does nothing if the PPU is
+     *  already there, so it can be called before every register access.
+     *
+     *  @param dot Master clock, in dots since power up (3 per CPU cycle)
+     */
+    void catchUp(uint64_t dot);
+    
+    /**
+     *  Gives the PPU a scheduler to post its events to: NMI (pending, or at vblank start when enabled), the end of
+     *  the visible frame, and the predicted sprite 0 hit. Register accesses sync the PPU on their own, so in
+     *  between these events the CPU can run freely.
+     */
+    void setScheduler(Scheduler* scheduler);
+    
+    // Reposts the NMI and end of frame events from the current position of the PPU
+    void postEvents();
+    
+    // Returns true if the PPU raised an NMI since the last poll
+    bool pollNMI();
+    
+    /**
+     *  Returns true if the PPU completed a visible frame (reached the post-render scanline) since the last poll.
+     *  The FRAME_END event only tells when to look: a register access may have caught the PPU up past the end of
+     *  the frame already, which reposts that event in the next frame.
+     */
+    bool pollFrameEnd();
+    
+    /**
+     *  Chooses whether the next frame gets its pixels composed. Skipped frames keep every side effect
+     *  (vblank/NMI timing, PPUSTATUS flags, sprite 0 hit, sprite overflow), but do no pixel composition or palette
+     *  lookups and leave the frame buffer holding the last rendered frame.
+     *
+     *  @param render False to skip the next frame
+     */
+    virtual void setFrameRendering(bool render);
+    
+    // Whether the current frame is being rendered
+    bool isRenderingFrame() const;
+    
+    uint64_t getFrameCount() const;
+    uint64_t getDotCount() const;
+    
+    /* ----- SNAPSHOTS ----- */
+    
+    /**
+     *  Copies the emulation state into a snapshot. The frame buffer isn't part of it: after loadState() it still
+     *  holds the last frame rendered, which is what run-ahead presents. Settings (region, palette, sink, scheduler,
+     *  deferred rendering, background caching) aren't either. VRAM must be saved separately, with the PPU memory.
+     */
+    virtual void saveState(PPUState& state) const;
+    
+    // Resumes from a snapshot taken by saveState() (the memory must be restored to the same point)
+    virtual void loadState(const PPUState& state);
+    
+    /* ----- SPRITE 0 HIT PREDICTION ----- */
+    
+    /**
+     *  Analytically finds the first dot at which an opaque pixel of sprite 0 overlaps an opaque background pixel,
+     *  assuming no PPU state changes from here on. Only the 8 pixels covered by sprite 0 on each of its lines are checked.
+     *
+     *  @param fromScanline First scanline to consider (0-239)
+     *  @param v Value of internal register v at the start of fromScanline (before the horizontal bits are copied from t)
+     *  @return Dot within the frame (scanline * DOTS_PER_SCANLINE + dot) where PPUSTATUS.S gets set, or NO_SPRITE_ZERO_HIT
+     */
+    int32_t predictSpriteZeroHit(int fromScanline, uint16_t v);
+    
+    /**
+     *  Finds the first pixel of scanline y where sprite 0 overlaps the background. Sprite 0 must be on the line.
+     *
+     *  @param y Scanline to check (1-239)
+     *  @param v Value of internal register v for the line (horizontal bits already copied from t)
+     *  @return X position of the hit, or -1 if there is none on this line
+     */
+    int spriteZeroHitX(int y, uint16_t v) const;
+    
+    /**
+     *  Gets the dot of this frame's sprite 0 hit, recomputing the prediction only if relevant state changed since
+     *  it was last computed. The CPU can safely run up to this dot without the PPU checking for a hit.
+     */
+    int32_t getSpriteZeroHitDot();
+    
+    /**
+     *  Schedules the sprite 0 hit event again after a register write in the visible frame, predicting from the next
+     *  scanline on with the current state (or cancels it if there is no hit left in this frame).
+     */
+    void rescheduleSpriteZeroHit();
     
     /* ----- DEBUG FUNCTIONS ----- */
-    void updateScreen() const;
+    virtual void updateScreen() const;
+    
+    // Read only access to the state the debug viewers are built from
+    const Memory& getMemory() const;
+    const Palette& getPalette() const;
+    
+    // Replaces the palette frames are presented with (the built in one by default)
+    void setPalette(const Palette& newPalette);
+    const std::array<uint8_t, 256>& getOAM() const;
+    uint8_t getControl() const;      // PPUCTRL
+    uint16_t getTempAddress() const; // Internal register t (scroll of the next frame)
+    uint8_t getFineX() const;
+    
+    // Write stamps of VRAM (see stampVRAMWrite), so a viewer only copies what was written since it last looked
+    uint64_t getVRAMWriteSeq() const;
+    const std::array<uint64_t, 0x1000>& getNametableWrites() const;
+    const std::array<uint64_t, 512>& getCHRWrites() const;
+    
     void debug() const;
+    
+    /**
+     *  Checks predictSpriteZeroHit() against a per pixel overlap check of every scanline of the frame.
+     *
+     *  @return True if both agree on the dot of the sprite 0 hit (or that there is none)
+     */
+    bool verifySpriteZeroPrediction();
+
+private:
+    
+    // Body of step(), with the frame limits of the region folded in
+    template <typename Timing>
+    void runDots(int dots);
+    
+    // Moves onto the next scanline, wrapping around to a new frame
+    template <typename Timing>
+    void nextScanline();
+    
+    // Dots left until the PPU reaches the given scanline and dot (wrapping into the next frame if needed)
+    template <typename Timing>
+    int dotsUntil(int scanline, int dot) const;
+    
+    // Records the registers of visible line y into the journal of the current frame
+    const RasterLine& recordRasterLine(int y);
+    
+    // Completes the journal of the visible frame (and renders it when deferred), and starts the next one
+    void finishJournal();
 };
 
 #endif /* PPU_hpp */
@@ -0,0 +1,35 @@
+//
+//  framebuffer.cpp
+//  emulator_6502
+//
+
+#include "framebuffer.hpp"
+
+void FrameBuffer::toRGBA(const Palette& palette, uint8_t* out) const
+{
+    const auto& lut = palette.getEmphasisLUT();
+
+    for (const uint16_t pixel : pixels)
+    {
+        const RGBField& color = lut[pixel & 0x1FF];
+        *out++ = color.r;
+        *out++ = color.g;
+        *out++ = color.b;
+        *out++ = 0xFF;
+    }
+}
+
+void FrameBuffer::lineToRGBA(int y, const Palette& palette, uint8_t* out) const
+{
+    const auto& lut = palette.getEmphasisLUT();
+    const uint16_t* line = scanline(y);
+
+    for (int x = 0; x < WIDTH; ++x)
+    {
+        const RGBField& color = lut[line[x] & 0x1FF];
+        *out++ = color.r;
+        *out++ = color.g;
+        *out++ = color.b;
+        *out++ = 0xFF;
+    }
+}
@@ -0,0 +1,66 @@
+//
+//  framebuffer.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+
+#include "palette.hpp"
+
+/*
+ Indexed representation of a single frame outputted by the PPU (256x240)
+
+ Each pixel stores what the PPU actually outputs rather than a final color:
+    bits 0-5: Color index into the 64 color system palette
+    bits 6-8: Emphasis bits (R, G, B) taken from PPUMASK at the time the pixel was drawn
+
+ Converting to RGBA is deferred until the frame is presented or exported, so frames that are
+ skipped, hashed, or otherwise inspected never pay for the expansion.
+ */
+struct FrameBuffer
+{
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 240;
+
+    std::array<uint16_t, WIDTH * HEIGHT> pixels {};
+    uint64_t frameNumber = 0;
+
+    /*
+     Frame number at which each line last changed (0: never drawn)
+
+     A consumer that remembers the frame number it last looked at only has to revisit the lines stamped after it,
+     which stays correct when it skips frames, unlike a dirty bitmap relative to the previous frame.
+     */
+    std::array<uint64_t, HEIGHT> lineChangedAt {};
+    uint64_t lastChangedAt = 0; // Latest of lineChangedAt
+
+    /// Stamps line y as changed in frame number `frame`
+    void markLineChanged(int y, uint64_t frame)
+    {
+        lineChangedAt[y] = frame;
+        lastChangedAt = frame;
+    }
+
+    /// Pointer to the first pixel of scanline y
+    uint16_t* scanline(int y) { return pixels.data() + (WIDTH * y); }
+    const uint16_t* scanline(int y) const { return pixels.data() + (WIDTH * y); }
+
+    /**
+     *  Expands the indexed frame into RGBA (4 bytes per pixel, alpha always 0xFF)
+     *
+     *  @param palette Palette whose emphasis LUT is used to resolve each pixel
+     *  @param out Destination buffer. Must hold at least WIDTH * HEIGHT * 4 bytes
+     */
+    void toRGBA(const Palette& palette, uint8_t* out) const;
+
+    /**
+     *  Same as toRGBA(), for a single line
+     *
+     *  @param y Line to expand
+     *  @param out Destination of the line. Must hold at least WIDTH * 4 bytes
+     */
+    void lineToRGBA(int y, const Palette& palette, uint8_t* out) const;
+};
@@ -0,0 +1,304 @@
+//
+//  framehash.cpp
+//  emulator_6502
+//
+
+#include "framehash.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRAMEHASH_USE_SSE2 1
+#endif
+
+static constexpr size_t LANES = 8;
+static constexpr size_t STRIPE_SIZE = LANES * sizeof(uint64_t);   // 64 bytes
+static constexpr size_t STRIPES_PER_BLOCK = 16;                    // Lanes are scrambled every KB
+
+static constexpr uint64_t PRIME32_1 = 0x9E3779B1;
+static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87;
+static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4F;
+static constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9;
+
+static constexpr uint64_t INITIAL_LANES[LANES] = {
+    0x00000000C2B2AE3D, PRIME64_1, PRIME64_2, PRIME64_3, 0x85EBCA77C2B2AE63, 0x0000000085EBCA77, 0x27D4EB2F165667C5, PRIME32_1
+};
+
+static constexpr uint64_t KEYS[LANES] = {
+    0xBE4BA423396CFEB8, 0x1CAD21F72C81017C, 0xDB979083E96DD4DE, 0x1F67B3B7A4A44072,
+    0x78E5C0CC4EE679CB, 0x2172FFCC7DD05A82, 0x8E2443F7744608B8, 0x4C263A81E69035E0
+};
+
+// Lanes are read little endian (x86 and ARM), which keeps hashes identical across the SIMD and scalar paths
+static inline uint64_t read64(const uint8_t* bytes)
+{
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+// Folds the 128 bit product of a and b into 64 bits
+static inline uint64_t multiplyFold(uint64_t a, uint64_t b)
+{
+    const uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32;
+    const uint64_t bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+    
+    const uint64_t loLo = aLo * bLo;
+    const uint64_t hiLo = aHi * bLo;
+    const uint64_t loHi = aLo * bHi;
+    const uint64_t hiHi = aHi * bHi;
+    
+    const uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + loHi;
+    const uint64_t upper = (hiLo >> 32) + (cross >> 32) + hiHi;
+    const uint64_t lower = (cross << 32) | (loLo & 0xFFFFFFFF);
+    
+    return upper ^ lower;
+}
+
+/* ---------- SCALAR PATH ---------- */
+
+static void accumulateStripes(uint64_t* acc, const uint8_t* data, size_t stripes)
+{
+    for (size_t stripe = 0; stripe < stripes; ++stripe, data += STRIPE_SIZE)
+    {
+        for (size_t lane = 0; lane < LANES; ++lane)
+        {
+            const uint64_t value = read64(data + (lane * 8));
+            const uint64_t keyed = value ^ KEYS[lane];
+            
+            // The raw value goes to the neighbouring lane, so no input bit can cancel out in its own lane
+            acc[lane ^ 1] += value;
+            acc[lane] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+    }
+}
+
+[[maybe_unused]] static void scramble(uint64_t* acc)
+{
+    for (size_t lane = 0; lane < LANES; ++lane)
+    {
+        acc[lane] ^= acc[lane] >> 47;
+        acc[lane] ^= KEYS[lane];
+        acc[lane] *= PRIME32_1;
+    }
+}
+
+/* ---------- SSE2 PATH ---------- */
+
+#ifdef FRAMEHASH_USE_SSE2
+
+// Same as accumulateStripes(), 2 lanes per register
+static void accumulateStripesSSE2(__m128i* acc, const uint8_t* data, size_t stripes)
+{
+    for (size_t stripe = 0; stripe < stripes; ++stripe, data += STRIPE_SIZE)
+    {
+        for (size_t i = 0; i < LANES / 2; ++i)
+        {
+            const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + (i * 16)));
+            const __m128i keyed = _mm_xor_si128(value, _mm_loadu_si128(reinterpret_cast<const __m128i*>(KEYS + (i * 2))));
+            
+            // Low 32 bits times high 32 bits of each 64 bit lane
+            const __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+            const __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            
+            acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+        }
+    }
+}
+
+static void scrambleSSE2(__m128i* acc)
+{
+    const __m128i prime = _mm_set1_epi32(static_cast<int>(PRIME32_1));
+    
+    for (size_t i = 0; i < LANES / 2; ++i)
+    {
+        __m128i lanes = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+        lanes = _mm_xor_si128(lanes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(KEYS + (i * 2))));
+        
+        // 64 bit by 32 bit multiply, from two 32x32 bit products
+        const __m128i lo = _mm_mul_epu32(lanes, prime);
+        const __m128i hi = _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(lanes, 32), prime), 32);
+        acc[i] = _mm_add_epi64(lo, hi);
+    }
+}
+
+#endif
+
+/* ---------- HASH ---------- */
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    
+    alignas(16) uint64_t acc[LANES];
+    for (size_t lane = 0; lane < LANES; ++lane)
+    {
+        acc[lane] = INITIAL_LANES[lane] ^ seed;
+    }
+    
+    const size_t blockSize = STRIPE_SIZE * STRIPES_PER_BLOCK;
+    const size_t blocks = size / blockSize;
+    const size_t stripes = (size % blockSize) / STRIPE_SIZE;
+
+#ifdef FRAMEHASH_USE_SSE2
+    __m128i accSSE2[LANES / 2];
+    for (size_t i = 0; i < LANES / 2; ++i)
+    {
+        accSSE2[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + (i * 2)));
+    }
+    
+    for (size_t block = 0; block < blocks; ++block, bytes += blockSize)
+    {
+        accumulateStripesSSE2(accSSE2, bytes, STRIPES_PER_BLOCK);
+        scrambleSSE2(accSSE2);
+    }
+    
+    accumulateStripesSSE2(accSSE2, bytes, stripes);
+    
+    for (size_t i = 0; i < LANES / 2; ++i)
+    {
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc + (i * 2)), accSSE2[i]);
+    }
+#else
+    for (size_t block = 0; block < blocks; ++block, bytes += blockSize)
+    {
+        accumulateStripes(acc, bytes, STRIPES_PER_BLOCK);
+        scramble(acc);
+    }
+    
+    accumulateStripes(acc, bytes, stripes);
+#endif
+    
+    bytes += stripes * STRIPE_SIZE;
+    
+    // The last partial stripe is padded with zeros (the length is mixed in below, so padding can't collide)
+    const size_t remaining = size % STRIPE_SIZE;
+    
+    if (remaining)
+    {
+        uint8_t last[STRIPE_SIZE] = {};
+        std::memcpy(last, bytes, remaining);
+        accumulateStripes(acc, last, 1);
+    }
+    
+    // Fold the lanes together, then avalanche so every input bit affects every output bit
+    uint64_t hash = (size * PRIME64_1) ^ seed;
+    
+    for (size_t lane = 0; lane < LANES; lane += 2)
+    {
+        hash += multiplyFold(acc[lane] ^ KEYS[(lane + 3) % LANES], acc[lane + 1] ^ KEYS[(lane + 6) % LANES]);
+    }
+    
+    hash ^= hash >> 37;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    
+    return hash;
+}
+
+uint64_t hashFrame(const FrameBuffer& frame)
+{
+    return hashBytes(frame.pixels.data(), frame.pixels.size() * sizeof(uint16_t));
+}
+
+/* ---------- HASH LOG ---------- */
+
+FrameHashLog::FrameHashLog() : m_lastFrameNumber(0), m_missingFrames(0) {}
+
+bool FrameHashLog::record(const FrameBuffer& frame)
+{
+    // Frame number 0 is the blank frame from before the first rendered frame
+    if (frame.frameNumber == 0 || frame.frameNumber == m_lastFrameNumber)
+        return false;
+    
+    // Only counted after the first frame: a run (or run-ahead) doesn't have to start recording at frame 1
+    if (!m_frameNumbers.empty() && frame.frameNumber > m_lastFrameNumber + 1)
+        m_missingFrames += frame.frameNumber - m_lastFrameNumber - 1;
+    
+    m_lastFrameNumber = frame.frameNumber;
+    m_hashes.push_back(hashFrame(frame));
+    m_frameNumbers.push_back(frame.frameNumber);
+    return true;
+}
+
+const std::vector<uint64_t>& FrameHashLog::getHashes() const
+{
+    return m_hashes;
+}
+
+const std::vector<uint64_t>& FrameHashLog::getFrameNumbers() const
+{
+    return m_frameNumbers;
+}
+
+uint64_t FrameHashLog::getMissingFrames() const
+{
+    return m_missingFrames;
+}
+
+void FrameHashLog::clear()
+{
+    m_hashes.clear();
+    m_frameNumbers.clear();
+    m_lastFrameNumber = 0;
+    m_missingFrames = 0;
+}
+
+bool FrameHashLog::save(const char* filename) const
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+    
+    for (size_t i = 0; i < m_hashes.size(); i++)
+    {
+        fprintf(file, "%llu %016llx\n", static_cast<unsigned long long>(m_frameNumbers[i]),
+                static_cast<unsigned long long>(m_hashes[i]));
+    }
+    
+    fclose(file);
+    return true;
+}
+
+bool FrameHashLog::load(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+    
+    clear();
+    
+    unsigned long long frameNumber, hash;
+    while (fscanf(file, "%llu %llx", &frameNumber, &hash) == 2)
+    {
+        if (!m_frameNumbers.empty() && frameNumber > m_lastFrameNumber + 1)
+            m_missingFrames += frameNumber - m_lastFrameNumber - 1;
+        
+        m_lastFrameNumber = frameNumber;
+        m_hashes.push_back(hash);
+        m_frameNumbers.push_back(frameNumber);
+    }
+    
+    fclose(file);
+    return true;
+}
+
+int64_t FrameHashLog::firstMismatch(const std::vector<uint64_t>& run, const std::vector<uint64_t>& golden)
+{
+    const size_t common = std::min(run.size(), golden.size());
+    const auto mismatch = std::mismatch(run.begin(), run.begin() + common, golden.begin());
+    
+    if (mismatch.first != run.begin() + common)
+        return mismatch.first - run.begin();
+    
+    return (run.size() == golden.size()) ? -1 : static_cast<int64_t>(common);
+}
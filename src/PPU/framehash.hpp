@@ -0,0 +1,85 @@
+//
+//  framehash.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "framebuffer.hpp"
+
+/**
+ *  Fast non cryptographic 64 bit hash, for comparing frames against golden runs
+ *
+ *  Eight 64 bit lanes each accumulate a 32x32 bit product of every 64 byte stripe of the input (mixed with a key),
+ *  and are scrambled every KB and folded together at the end. The SSE2 path and the scalar path give the same
+ *  result, so hashes recorded on one machine can be compared on any other.
+ *
+ *  @param data Bytes to hash
+ *  @param size Number of bytes
+ *  @param seed Changes the whole hash
+ *  @return 64 bit hash
+ */
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+/**
+ *  Hashes the indexed pixels of a frame (color and emphasis bits). Nothing is converted to RGBA, so two frames
+ *  hash the same exactly when the PPU outputted the same frame, whatever palette is used to present it.
+ */
+uint64_t hashFrame(const FrameBuffer& frame);
+
+/*
+ Hash of every frame completed during a run, in order, along with the PPU frame number it was recorded at
+ */
+class FrameHashLog
+{
+    std::vector<uint64_t> m_hashes;
+    std::vector<uint64_t> m_frameNumbers;
+    uint64_t m_lastFrameNumber;
+    uint64_t m_missingFrames;
+
+public:
+    
+    FrameHashLog();
+    
+    /**
+     *  Hashes the frame if it wasn't recorded yet (skipped frames leave the frame number unchanged, so they're ignored).
+     *  Frame numbers jumping ahead of the last recorded one are counted as missing frames.
+     *
+     *  @return True if the frame was recorded
+     */
+    bool record(const FrameBuffer& frame);
+    
+    // Hash stream of the run
+    const std::vector<uint64_t>& getHashes() const;
+    
+    // PPU frame number of each hash
+    const std::vector<uint64_t>& getFrameNumbers() const;
+    
+    /**
+     *  Frames that completed between two recorded ones without being recorded. Always 0 for a run that presents every
+     *  frame, so comparing hash streams by index also compares them by PPU frame; frame skipping adds to it.
+     */
+    uint64_t getMissingFrames() const;
+    
+    void clear();
+    
+    /**
+     *  Saves/loads the hash stream as text, one frame number and 16 digit hex hash per line
+     *
+     *  @return False if the file couldn't be written/read
+     */
+    bool save(const char* filename) const;
+    bool load(const char* filename);
+    
+    /**
+     *  Finds the first frame that differs between two runs
+     *
+     *  @return Index of the first differing frame, the length of the shorter run if one is a prefix of the other,
+     *          or -1 if both are identical
+     */
+    static int64_t firstMismatch(const std::vector<uint64_t>& run, const std::vector<uint64_t>& golden);
+};
@@ -7,35 +7,169 @@
 
 #include "palette.hpp"
 
-Palette::Palette(const char* filename)
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+
+Palette::Palette() : m_COLOR_PALETTE(DEFAULT_COLORS)
+{
+    buildEmphasisLUT();
+}
+
+Palette::Palette(const char* filename) : Palette()
 {
     loadPaletteFile(filename);
 }
 
-void Palette::loadPaletteFile(const char* filename)
+bool Palette::loadPaletteFile(const char* filename)
 {
     FILE* file = fopen(filename, "rb");
     if (!file)
     {
         perror("Error opening file");
-        return;
+        return false;
     }
     
-    struct RGBField palette[64];
-    auto read = fread(palette, sizeof(RGBField), 64, file);
+    // One extra entry is read to tell a 512 color file from a longer, invalid one
+    struct RGBField palette[513];
+    auto read = fread(palette, sizeof(RGBField), 513, file);
+    fclose(file);
     
-    if (read != 64) // .pal always reads 64 lines (64 colors)
+    if (read == 64) // Base colors only
     {
-        perror("Invalid palette file!");
-        fclose(file);
-        return;
+        std::copy(palette, palette + 64, m_COLOR_PALETTE.begin());
+        buildEmphasisLUT();
+        return true;
     }
     
-    m_COLOR_PALETTE = std::to_array(palette);
-    fclose(file);
+    if (read == 512) // Every color under every emphasis, in the same order as the lookup table
+    {
+        std::copy(palette, palette + 64, m_COLOR_PALETTE.begin());
+        std::copy(palette, palette + 512, m_EMPHASIS_LUT.begin());
+        return true;
+    }
+    
+    fprintf(stderr, "Invalid palette file! (%s must hold 64 or 512 colors)\n", filename);
+    return false;
+}
+
+void Palette::generateNTSC(const NTSCPaletteSettings& settings)
+{
+    constexpr int WINDOW = 12; // One subcarrier period
+    
+    // Subcarrier at each sample of the period, in the decoder's reference (burst and hue)
+    const float hueOffset = BURST_OFFSET + (settings.hue * WINDOW / 360.0f);
+    
+    std::array<float, WINDOW> cosines;
+    std::array<float, WINDOW> sines;
+    
+    for (int phase = 0; phase < WINDOW; ++phase)
+    {
+        const float angle = static_cast<float>(M_PI) * (phase + hueOffset) / 6.0f;
+        cosines[phase] = std::cos(angle);
+        sines[phase] = std::sin(angle);
+    }
+    
+    const float chromaGain = 2.0f * settings.saturation * settings.contrast / WINDOW;
+    const float lumaGain = settings.contrast / WINDOW;
+    const float inverseGamma = 1.0f / settings.gamma;
+    
+    auto toChannel = [inverseGamma](float value)
+    {
+        value = std::clamp(value, 0.0f, 1.0f);
+        
+        if (inverseGamma != 1.0f)
+            value = std::pow(value, inverseGamma);
+        
+        return static_cast<uint8_t>(std::lround(value * 255.0f));
+    };
+    
+    for (uint16_t color = 0; color < 512; ++color)
+    {
+        // A flat color decodes the same anywhere on the line, so a single period of the signal is enough
+        float y = 0, i = 0, q = 0;
+        
+        for (int phase = 0; phase < WINDOW; ++phase)
+        {
+            const float level = compositeLevel(color, phase);
+            y += level;
+            i += level * cosines[phase];
+            q += level * sines[phase];
+        }
+        
+        y = (y * lumaGain) + settings.brightness;
+        i *= chromaGain;
+        q *= chromaGain;
+        
+        // YIQ to RGB (FCC matrix)
+        RGBField& rgb = m_EMPHASIS_LUT[color];
+        rgb.r = toChannel(y + (0.946882f * i) + (0.623557f * q));
+        rgb.g = toChannel(y - (0.274788f * i) - (0.635691f * q));
+        rgb.b = toChannel(y - (1.108545f * i) + (1.709007f * q));
+    }
+    
+    std::copy(m_EMPHASIS_LUT.begin(), m_EMPHASIS_LUT.begin() + 64, m_COLOR_PALETTE.begin());
+}
+
+float Palette::compositeLevel(uint16_t color, int phase)
+{
+    // Voltages relative to sync, low then high level of the square wave for each luma
+    static constexpr float LEVELS[8] = { 0.350f, 0.518f, 0.962f, 1.550f,
+                                         1.094f, 1.506f, 1.962f, 1.962f };
+    static constexpr float BLACK = 0.518f;
+    static constexpr float WHITE = 1.962f;
+    static constexpr float ATTENUATION = 0.746f;
+    
+    const int hue = color & 0x0F;
+    const int luma = (hue > 13) ? 1 : (color >> 4) & 0x03; // Hues 14-15 are forced to level 1 (black)
+    const int emphasis = (color >> 6) & 0x07;
+    
+    float low = LEVELS[luma];
+    float high = LEVELS[4 + luma];
+    
+    if (hue == 0)
+        low = high;     // Hue 0 only outputs the high level (greys and white)
+    else if (hue > 12)
+        high = low;     // Hues 13-15 only output the low level
+    
+    // A hue is high during half of the subcarrier period, starting at a phase given by the hue
+    auto inPhase = [phase](int hue) { return (hue + phase) % 12 < 6; };
+    
+    float signal = inPhase(hue) ? high : low;
+    
+    // Emphasis bits (red, green, blue) attenuate the signal during their own third of the period
+    if (((emphasis & 0x01) && inPhase(0)) || ((emphasis & 0x02) && inPhase(4)) || ((emphasis & 0x04) && inPhase(8)))
+        signal *= ATTENUATION;
+    
+    return (signal - BLACK) / (WHITE - BLACK);
 }
 
 const std::array<RGBField, 64> Palette::getPalette() const
 {
     return m_COLOR_PALETTE;
 }
+
+const std::array<RGBField, 512>& Palette::getEmphasisLUT() const
+{
+    return m_EMPHASIS_LUT;
+}
+
+void Palette::buildEmphasisLUT()
+{
+    // Emphasizing a channel darkens the other two by roughly 18%
+    constexpr int ATTENUATION = 209; // ~0.816 in 8.8 fixed point
+    
+    for (int emphasis = 0; emphasis < 8; ++emphasis)
+    {
+        for (int color = 0; color < 64; ++color)
+        {
+            RGBField rgb = m_COLOR_PALETTE[color];
+            
+            if (emphasis & 0x06) rgb.r = (rgb.r * ATTENUATION) >> 8; // Green or blue emphasized
+            if (emphasis & 0x05) rgb.g = (rgb.g * ATTENUATION) >> 8; // Red or blue emphasized
+            if (emphasis & 0x03) rgb.b = (rgb.b * ATTENUATION) >> 8; // Red or green emphasized
+            
+            m_EMPHASIS_LUT[(emphasis << 6) | color] = rgb;
+        }
+    }
+}
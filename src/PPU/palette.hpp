@@ -15,23 +15,96 @@ struct RGBField
     uint8_t r;
     uint8_t g;
     uint8_t b;
+    
+    bool operator==(const RGBField& other) const = default;
+};
+
+/*
+ Controls of the procedural NTSC palette, like the knobs of a TV
+ */
+struct NTSCPaletteSettings
+{
+    float hue = 0.0f;           // Hue rotation in degrees
+    float saturation = 1.0f;    // Chroma gain
+    float contrast = 1.0f;      // Gain of the whole signal
+    float brightness = 0.0f;    // Offset added to luma (1 = black to white)
+    float gamma = 1.0f;         // Gamma correction of the decoded colors (1 = none, > 1 brightens the midtones)
 };
 
 class Palette
 {
     std::array<RGBField, 64> m_COLOR_PALETTE;
     
+    // Every color under every combination of the 3 emphasis bits (index = emphasis << 6 | color)
+    std::array<RGBField, 512> m_EMPHASIS_LUT;
+
 public:
     
+    // Built in palette (res/Composite_wiki.pal), so no file has to be found at startup
+    static constexpr std::array<RGBField, 64> DEFAULT_COLORS = {{
+        {0x62, 0x62, 0x62}, {0x00, 0x2E, 0x98}, {0x0C, 0x11, 0xC2}, {0x3B, 0x00, 0xC2}, // $00-$03
+        {0x65, 0x00, 0x98}, {0x7D, 0x00, 0x4E}, {0x7D, 0x00, 0x00}, {0x65, 0x19, 0x00}, // $04-$07
+        {0x3B, 0x36, 0x00}, {0x0C, 0x4F, 0x00}, {0x00, 0x5B, 0x00}, {0x00, 0x59, 0x00}, // $08-$0B
+        {0x00, 0x49, 0x4E}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, // $0C-$0F
+        {0xAB, 0xAB, 0xAB}, {0x00, 0x64, 0xF4}, {0x35, 0x3C, 0xFF}, {0x76, 0x1B, 0xFF}, // $10-$13
+        {0xAE, 0x0A, 0xF4}, {0xCF, 0x0C, 0x8F}, {0xCF, 0x23, 0x1C}, {0xAE, 0x47, 0x00}, // $14-$17
+        {0x76, 0x6F, 0x00}, {0x35, 0x90, 0x00}, {0x00, 0xA1, 0x00}, {0x00, 0x9E, 0x1C}, // $18-$1B
+        {0x00, 0x88, 0x8F}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, // $1C-$1F
+        {0xFF, 0xFF, 0xFF}, {0x4A, 0xB5, 0xFF}, {0x85, 0x8C, 0xFF}, {0xC8, 0x6A, 0xFF}, // $20-$23
+        {0xFF, 0x58, 0xFF}, {0xFF, 0x5B, 0xE2}, {0xFF, 0x72, 0x6A}, {0xFF, 0x97, 0x02}, // $24-$27
+        {0xC8, 0xC1, 0x00}, {0x85, 0xE3, 0x00}, {0x4A, 0xF5, 0x02}, {0x29, 0xF2, 0x6A}, // $28-$2B
+        {0x29, 0xDB, 0xE2}, {0x4E, 0x4E, 0x4E}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, // $2C-$2F
+        {0xFF, 0xFF, 0xFF}, {0xB6, 0xE1, 0xFF}, {0xCE, 0xD1, 0xFF}, {0xE9, 0xC3, 0xFF}, // $30-$33
+        {0xFF, 0xBC, 0xFF}, {0xFF, 0xBD, 0xF4}, {0xFF, 0xC6, 0xC3}, {0xFF, 0xD5, 0x9A}, // $34-$37
+        {0xE9, 0xE6, 0x81}, {0xCE, 0xF4, 0x81}, {0xB6, 0xFB, 0x9A}, {0xA9, 0xFA, 0xC3}, // $38-$3B
+        {0xA9, 0xF0, 0xF4}, {0xB8, 0xB8, 0xB8}, {0x00, 0x00, 0x00}, {0x00, 0x00, 0x00}, // $3C-$3F
+    }};
+    
+    // Phase (in samples) the decoder's color burst is offset by, before the hue adjustment
+    static constexpr float BURST_OFFSET = 3.9f;
+    
+    // Starts with the built in palette
+    Palette();
+    
+    // Starts with the built in palette, then loads a palette file over it (keeping the built in one if that fails)
     Palette(const char* filename);
     
     /**
      *  Loads a color palette file into the color palette variable.
      *
-     *  @param filename File which to read the palette from. Must be a .pal file.
+     *  @param filename File which to read the palette from. Must be a .pal file, of either 64 colors (the emphasized
+     *                  colors are then derived from them) or 512 colors (every color under every emphasis)
+     *  @return False if the file couldn't be read, in which case the palette is left unchanged
      */
-    void loadPaletteFile(const char* filename);
+    bool loadPaletteFile(const char* filename);
+    
+    /**
+     *  Replaces the palette with one decoded from a model of the PPU's composite signal, the same as the NTSC filter uses.
+     *  Emphasized colors come from the attenuated signal rather than being derived from the base colors.
+     *
+     *  @param settings Decoder controls
+     */
+    void generateNTSC(const NTSCPaletteSettings& settings = NTSCPaletteSettings());
+    
+    /**
+     *  Voltage the PPU outputs for a color, relative to black (0) and white (1)
+     *
+     *  @param color 9 bit color (emphasis, luma, hue)
+     *  @param phase Subcarrier phase of the sample (0-11)
+     */
+    static float compositeLevel(uint16_t color, int phase);
     
     /// Get the color palette
     const std::array<RGBField, 64> getPalette() const;
+    
+    /// Get the emphasis lookup table (indexed by the 9 bit pixel value the PPU outputs)
+    const std::array<RGBField, 512>& getEmphasisLUT() const;
+
+private:
+    
+    /**
+     *  Rebuilds the emphasis lookup table from the current color palette.
+     *  Each emphasized channel keeps its value, while the other channels are attenuated.
+     */
+    void buildEmphasisLUT();
 };
@@ -0,0 +1,189 @@
+//
+//  pipeline.cpp
+//  emulator_6502
+//
+
+#include "pipeline.hpp"
+
+PipelinedPPU::PipelinedPPU(Memory& shadowMem, Memory& renderMem, VideoSink* sink)
+    : PPU(shadowMem, sink), m_renderer(renderMem, nullptr), m_renderMemory(renderMem), m_logged(0), m_processed(0),
+      m_renderRequested(true)
+{
+    // The shadow model only needs side effects, never pixels
+    PPU::setFrameRendering(false);
+    m_renderingThisFrame = false;
+    
+    m_renderThread = std::thread(&PipelinedPPU::renderLoop, this);
+}
+
+PipelinedPPU::~PipelinedPPU()
+{
+    log(PPUCommand::Type::STOP);
+    m_renderThread.join();
+}
+
+/* ---------- CPU THREAD ---------- */
+
+uint8_t PipelinedPPU::read(uint16_t addr)
+{
+    uint8_t value = PPU::read(addr);
+    
+    // PPUSTATUS (clears vblank and w) and PPUDATA (moves v, fills the read buffer) change the state of the PPU
+    if (addr == 0x2002 || addr == 0x2007)
+    {
+        log(PPUCommand::Type::READ, addr);
+    }
+    
+    return value;
+}
+
+void PipelinedPPU::write(uint16_t addr, uint8_t result)
+{
+    PPU::write(addr, result);
+    log(PPUCommand::Type::WRITE, addr, result);
+}
+
+void PipelinedPPU::writeOAMDMA(const std::array<uint8_t, 256>& page)
+{
+    PPU::writeOAMDMA(page);
+    
+    // Replay the page as OAMDATA writes: 256 increments bring OAMADDR back to where it started, just like DMA
+    for (uint8_t byte : page)
+    {
+        log(PPUCommand::Type::WRITE, 0x2004, byte);
+    }
+}
+
+void PipelinedPPU::step(int dots)
+{
+    PPU::step(dots);
+    
+    // Lets the render thread render the lines the shadow model just went through, while the CPU runs on
+    log(PPUCommand::Type::SYNC);
+}
+
+void PipelinedPPU::setRegion(Region region)
+{
+    // The render thread only touches the renderer after popping a command, which orders it after this
+    m_renderer.setRegion(region);
+    PPU::setRegion(region);
+}
+
+void PipelinedPPU::setFrameRendering(bool render)
+{
+    m_renderRequested = render;
+    log(PPUCommand::Type::RENDER, 0, render);
+}
+
+const FrameBuffer& PipelinedPPU::getFrame() const
+{
+    waitForRenderer();
+    return m_renderer.getFrame();
+}
+
+void PipelinedPPU::updateScreen() const
+{
+    if (sink)
+    {
+        sink->presentFrame(getFrame(), palette);
+    }
+}
+
+void PipelinedPPU::saveState(PPUState& state) const
+{
+    PPU::saveState(state);
+    
+    waitForRenderer();
+    state.renderNextFrame = m_renderRequested;
+    state.renderingThisFrame = m_renderer.isRenderingFrame();
+}
+
+void PipelinedPPU::loadState(const PPUState& state)
+{
+    // The render thread is idle until the next command, so the render side can be restored from here
+    waitForRenderer();
+    
+    m_renderer.loadState(state);
+    memory.saveContents(m_vramCopy);
+    m_renderMemory.loadContents(m_vramCopy);
+    
+    // The shadow model never fills its background cache, so the one in the snapshot can't be trusted
+    m_renderer.invalidateBackgroundCache();
+    
+    PPU::loadState(state);
+    m_renderRequested = state.renderNextFrame;
+    m_renderNextFrame = false;
+    m_renderingThisFrame = false;
+}
+
+void PipelinedPPU::log(PPUCommand::Type type, uint16_t addr, uint8_t value)
+{
+    PPUCommand command { getDotCount(), addr, value, type };
+    
+    while (!m_log.push(command))
+    {
+        // Log is full: make sure the render thread is awake, and give it time to drain
+        m_log.notify();
+        std::this_thread::yield();
+    }
+    
+    m_logged++;
+    m_log.notify();
+}
+
+void PipelinedPPU::waitForRenderer() const
+{
+    uint64_t processed = m_processed.load(std::memory_order_acquire);
+    
+    while (processed != m_logged)
+    {
+        m_processed.wait(processed, std::memory_order_acquire);
+        processed = m_processed.load(std::memory_order_acquire);
+    }
+}
+
+/* ---------- RENDER THREAD ---------- */
+
+void PipelinedPPU::renderLoop()
+{
+    PPUCommand command;
+    uint64_t processed = 0;
+    
+    while (true)
+    {
+        if (!m_log.pop(command))
+        {
+            // Caught up: wake the CPU thread if it waits for the rendered frame
+            m_processed.notify_all();
+            m_log.waitForData();
+            continue;
+        }
+        
+        if (command.type == PPUCommand::Type::STOP)
+            break;
+        
+        // Run the renderer up to the dot the access happened at
+        if (command.dot > m_renderer.getDotCount())
+        {
+            m_renderer.step(static_cast<int>(command.dot - m_renderer.getDotCount()));
+        }
+        
+        switch (command.type)
+        {
+            case PPUCommand::Type::WRITE:
+                m_renderer.write(command.addr, command.value);
+                break;
+            case PPUCommand::Type::READ:
+                m_renderer.read(command.addr);
+                break;
+            case PPUCommand::Type::RENDER:
+                m_renderer.setFrameRendering(command.value);
+                break;
+            
+            default:
+                break;
+        }
+        
+        m_processed.store(++processed, std::memory_order_release);
+    }
+}
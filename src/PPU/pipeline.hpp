@@ -0,0 +1,112 @@
+//
+//  pipeline.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// LIB includes
+#include "PPU.hpp"
+#include "../util/ringbuffer.hpp"
+
+/*
+ Register access recorded by the CPU thread, replayed by the render thread at the same dot
+ */
+struct PPUCommand
+{
+    enum class Type : uint8_t { WRITE, READ, RENDER, SYNC, STOP };
+    
+    uint64_t dot;   // PPU dot (since power up) at which the access happened
+    uint16_t addr;
+    uint8_t value;
+    Type type;
+};
+
+/*
+ PPU that renders on its own thread
+ 
+ The PPU the CPU talks to (this class) is a shadow model that never composes pixels: it runs every frame in
+ skip mode, which still produces exact PPUSTATUS flags, NMI timing, and PPUDATA read buffer contents. Every
+ register write and side effecting read is appended, time stamped, to a lock-free log. The render thread owns
+ a second PPU with its own copy of VRAM, replays the log at the same dots, and renders the frames in parallel.
+ 
+ Both PPUs receive identical inputs at identical dots, so the rendered frames are exactly the ones a single
+ threaded PPU would have produced. Whatever reads pixels (getFrame(), updateScreen()) or the whole state
+ (snapshots) first waits for the render thread to reach the shadow model, and then reads the render side.
+ 
+ Rendering settings (deferred rendering, background caching) stay at their defaults on the render thread.
+ */
+class PipelinedPPU : public PPU
+{
+    // PPU that does the actual rendering, only touched by the render thread (or while it waits for commands)
+    PPU m_renderer;
+    Memory& m_renderMemory;
+    
+    RingBuffer<PPUCommand, 8192> m_log;
+    std::thread m_renderThread;
+    
+    // Commands logged by the CPU thread, and commands the render thread has finished
+    uint64_t m_logged;
+    std::atomic<uint64_t> m_processed;
+    
+    // Frame rendering requested through setFrameRendering() (the shadow model itself always skips)
+    bool m_renderRequested;
+    
+    // Reused to copy VRAM into the render side when a snapshot is loaded
+    std::vector<uint8_t> m_vramCopy;
+
+public:
+    
+    /**
+     *  @param shadowMem VRAM used by the CPU side shadow model
+     *  @param renderMem VRAM used by the render thread. Must start with the same contents as shadowMem (e.g. CHR ROM)
+     *  @param sink Sink the rendered frames are presented to (from the thread calling updateScreen())
+     */
+    PipelinedPPU(Memory& shadowMem, Memory& renderMem, VideoSink* sink);
+    ~PipelinedPPU() override;
+    
+    uint8_t read(uint16_t addr) override;
+    void write(uint16_t addr, uint8_t result) override;
+    void writeOAMDMA(const std::array<uint8_t, 256>& page) override;
+    
+    // Runs the shadow model, and lets the render thread follow it up to the same dot
+    void step(int dots) override;
+    
+    // Sets the region of both PPUs. Like on PPU, must be called before anything is logged
+    void setRegion(Region region) override;
+    
+    // Forwarded to the render thread, at the dot it was requested at
+    void setFrameRendering(bool render) override;
+    
+    /**
+     *  Latest frame rendered by the render thread, once it caught up with the shadow model. Stays valid until the
+     *  CPU side runs again.
+     */
+    const FrameBuffer& getFrame() const override;
+    
+    // Presents the frame returned by getFrame()
+    void updateScreen() const override;
+    
+    /**
+     *  Snapshots are taken from the shadow model, with the frame rendering flags of the render side. The PPU
+     *  memory has to be restored before loadState() is called, since it is copied into the render side's VRAM.
+     */
+    void saveState(PPUState& state) const override;
+    void loadState(const PPUState& state) override;
+
+private:
+    
+    // Appends a command to the log and wakes the render thread, waiting for it if the log is full
+    void log(PPUCommand::Type type, uint16_t addr = 0, uint8_t value = 0);
+    
+    // Blocks until the render thread replayed every logged command, after which it only waits for new ones
+    void waitForRenderer() const;
+    
+    // Body of the render thread
+    void renderLoop();
+};
@@ -0,0 +1,373 @@
+//
+//  viewers.cpp
+//  emulator_6502
+//
+
+#include "viewers.hpp"
+
+#include <algorithm>
+
+// Sizes of the copies kept of each source
+static constexpr std::array<size_t, 5> SOURCE_SIZES = { 0x1000, 0x2000, 0x20, 256, 1 };
+
+// Color of the scroll window outline
+static constexpr RGBField SCROLL_WINDOW_COLOR = { 0xFF, 0x00, 0xFF };
+
+// Resizes an image, filled with opaque black
+static void clearImage(ViewerImage& image, int width, int height)
+{
+    image.width = width;
+    image.height = height;
+    image.rgba.assign(static_cast<size_t>(width) * height * 4, 0);
+    
+    for (size_t i = 3; i < image.rgba.size(); i += 4)
+    {
+        image.rgba[i] = 0xFF;
+    }
+}
+
+PPUViewers::PPUViewers(const PPU& ppu) : m_ppu(ppu), m_scrollDrawnOn(0), m_scrollT(0), m_scrollX(0)
+{
+    for (int source = 0; source < SOURCE_COUNT; ++source)
+    {
+        m_sources[source].data.assign(SOURCE_SIZES[source], 0);
+    }
+}
+
+/* ---------- VIEWS ---------- */
+
+const ViewerImage& PPUViewers::nametables(bool showScroll)
+{
+    if (needsRedraw(m_nametables, { NAMETABLES, CHR, PALETTE_RAM, CONTROL }))
+    {
+        drawNametables(m_nametables.image);
+    }
+    
+    if (!showScroll)
+        return m_nametables.image;
+    
+    // The outline is redrawn on its own when only the scroll moved
+    uint16_t t = m_ppu.getTempAddress();
+    uint8_t fineX = m_ppu.getFineX();
+    
+    if (m_scrollDrawnOn != m_nametables.image.version || t != m_scrollT || fineX != m_scrollX)
+    {
+        uint64_t version = m_nametablesWithScroll.version;
+        m_nametablesWithScroll = m_nametables.image;
+        m_nametablesWithScroll.version = version + 1;
+        
+        drawScrollWindow(m_nametablesWithScroll, t, fineX);
+        
+        m_scrollDrawnOn = m_nametables.image.version;
+        m_scrollT = t;
+        m_scrollX = fineX;
+    }
+    
+    return m_nametablesWithScroll;
+}
+
+const ViewerImage& PPUViewers::patternTables()
+{
+    if (needsRedraw(m_patternTables, { CHR, PALETTE_RAM }))
+    {
+        drawPatternTables(m_patternTables.image);
+    }
+    
+    return m_patternTables.image;
+}
+
+const ViewerImage& PPUViewers::palette()
+{
+    if (needsRedraw(m_palette, { PALETTE_RAM }))
+    {
+        drawPalette(m_palette.image);
+    }
+    
+    return m_palette.image;
+}
+
+const ViewerImage& PPUViewers::oam()
+{
+    if (needsRedraw(m_oam, { OAM, CHR, PALETTE_RAM, CONTROL }))
+    {
+        drawOAM(m_oam.image);
+    }
+    
+    return m_oam.image;
+}
+
+/* ---------- CHANGE TRACKING ---------- */
+
+bool PPUViewers::needsRedraw(View& view, std::initializer_list<Source> sources)
+{
+    bool changed = !view.drawn;
+    
+    for (Source source : sources)
+    {
+        refreshSource(source);
+        
+        if (view.drawnWith[source] != m_sources[source].generation)
+        {
+            view.drawnWith[source] = m_sources[source].generation;
+            changed = true;
+        }
+    }
+    
+    if (changed)
+    {
+        view.drawn = true;
+        view.image.version++;
+    }
+    
+    return changed;
+}
+
+void PPUViewers::refreshSource(Source source)
+{
+    const Memory& memory = m_ppu.getMemory();
+    SourceCopy& copy = m_sources[source];
+    bool changed = false;
+    
+    auto update = [&changed](uint8_t& byte, uint8_t value)
+    {
+        if (byte != value)
+        {
+            byte = value;
+            changed = true;
+        }
+    };
+    
+    // VRAM sources only need to be looked at again when PPUDATA was written. A write sequence going backwards means
+    // the PPU was powered up again or restored from a snapshot, so everything is copied.
+    const uint64_t writeSeq = m_ppu.getVRAMWriteSeq();
+    const bool vramSource = (source == NAMETABLES || source == CHR || source == PALETTE_RAM);
+    const bool fullCopy = !copy.copied || writeSeq < copy.writeSeq;
+    
+    if (vramSource && !fullCopy && writeSeq == copy.writeSeq)
+        return;
+    
+    switch (source)
+    {
+        case NAMETABLES:
+        {
+            // Read through the mirroring so every logical nametable is filled in
+            const std::array<uint64_t, 0x1000>& stamps = m_ppu.getNametableWrites();
+            
+            for (uint16_t i = 0; i < copy.data.size(); ++i)
+            {
+                if (fullCopy || stamps[i] > copy.writeSeq)
+                    update(copy.data[i], memory.read(0x2000 + i));
+            }
+            break;
+        }
+        case CHR:
+        {
+            const std::array<uint64_t, 512>& stamps = m_ppu.getCHRWrites();
+            
+            for (uint16_t tile = 0; tile < stamps.size(); ++tile)
+            {
+                if (!fullCopy && stamps[tile] <= copy.writeSeq)
+                    continue;
+                
+                for (uint16_t i = tile * 16; i < (tile * 16) + 16; ++i)
+                    update(copy.data[i], memory.read(i));
+            }
+            break;
+        }
+        case PALETTE_RAM:
+            // Palette writes aren't stamped individually, and there are only 32 entries
+            for (uint16_t i = 0; i < copy.data.size(); ++i)
+                update(copy.data[i], memory.read(0x3F00 + i));
+            break;
+        case OAM:
+            for (size_t i = 0; i < copy.data.size(); ++i)
+                update(copy.data[i], m_ppu.getOAM()[i]);
+            break;
+        case CONTROL:
+            // Only the pattern table selects and the sprite size affect the views
+            update(copy.data[0], m_ppu.getControl() & 0x38);
+            break;
+        default:
+            break;
+    }
+    
+    copy.writeSeq = writeSeq;
+    copy.copied = true;
+    
+    if (changed)
+        copy.generation++;
+}
+
+void PPUViewers::reset()
+{
+    for (SourceCopy& copy : m_sources)
+    {
+        copy.copied = false;
+    }
+}
+
+/* ---------- DRAWING ---------- */
+
+uint8_t PPUViewers::vram(uint16_t addr) const
+{
+    if (addr < 0x2000)
+        return m_sources[CHR].data[addr];
+    else if (addr < 0x3000)
+        return m_sources[NAMETABLES].data[addr - 0x2000];
+    
+    return m_sources[PALETTE_RAM].data[addr & 0x1F];
+}
+
+void PPUViewers::plot(ViewerImage& image, int x, int y, uint8_t paletteEntry) const
+{
+    const RGBField& color = m_ppu.getPalette().getEmphasisLUT()[vram(0x3F00 | paletteEntry) & 0x3F];
+    uint8_t* pixel = image.rgba.data() + (static_cast<size_t>(y) * image.width + x) * 4;
+    
+    pixel[0] = color.r;
+    pixel[1] = color.g;
+    pixel[2] = color.b;
+}
+
+void PPUViewers::drawTile(ViewerImage& image, int x, int y, uint16_t tileAddr, uint8_t paletteBase,
+                          bool flipH, bool flipV) const
+{
+    for (int row = 0; row < 8; ++row)
+    {
+        int sourceRow = flipV ? 7 - row : row;
+        uint8_t lo = vram(tileAddr + sourceRow);
+        uint8_t hi = vram(tileAddr + sourceRow + 8);
+        
+        for (int col = 0; col < 8; ++col)
+        {
+            int bit = flipH ? col : 7 - col;
+            uint8_t pixel = ((lo >> bit) & 0x01) | (((hi >> bit) & 0x01) << 1);
+            
+            // Transparent pixels show the universal background color
+            plot(image, x + col, y + row, pixel ? paletteBase + pixel : 0);
+        }
+    }
+}
+
+void PPUViewers::drawNametables(ViewerImage& image) const
+{
+    clearImage(image, 512, 480);
+    
+    const uint16_t patternBase = (m_sources[CONTROL].data[0] & 0x10) ? 0x1000 : 0x0000;
+    
+    for (int nametable = 0; nametable < 4; ++nametable)
+    {
+        const uint16_t base = 0x2000 + (nametable * 0x0400);
+        const int originX = (nametable & 0x01) * 256;
+        const int originY = (nametable >> 1) * 240;
+        
+        for (int tileY = 0; tileY < 30; ++tileY)
+        {
+            for (int tileX = 0; tileX < 32; ++tileX)
+            {
+                uint8_t tile = vram(base + (tileY * 32) + tileX);
+                uint8_t attribute = vram(base + 0x03C0 + ((tileY / 4) * 8) + (tileX / 4));
+                uint8_t palette = (attribute >> (((tileY & 0x02) << 1) | (tileX & 0x02))) & 0x03;
+                
+                drawTile(image, originX + (tileX * 8), originY + (tileY * 8), patternBase + (tile * 16), palette << 2);
+            }
+        }
+    }
+}
+
+void PPUViewers::drawPatternTables(ViewerImage& image) const
+{
+    clearImage(image, 256, 128 * 8);
+    
+    for (int palette = 0; palette < 8; ++palette)
+    {
+        for (int table = 0; table < 2; ++table)
+        {
+            for (int tile = 0; tile < 256; ++tile)
+            {
+                drawTile(image, (table * 128) + ((tile % 16) * 8), (palette * 128) + ((tile / 16) * 8),
+                         (table * 0x1000) + (tile * 16), palette << 2);
+            }
+        }
+    }
+}
+
+void PPUViewers::drawPalette(ViewerImage& image) const
+{
+    clearImage(image, 256, 32);
+    
+    for (int entry = 0; entry < 32; ++entry)
+    {
+        for (int y = 0; y < 16; ++y)
+        {
+            for (int x = 0; x < 16; ++x)
+            {
+                plot(image, ((entry % 16) * 16) + x, ((entry / 16) * 16) + y, entry);
+            }
+        }
+    }
+}
+
+void PPUViewers::drawOAM(ViewerImage& image) const
+{
+    clearImage(image, 64, 128);
+    
+    const std::vector<uint8_t>& oam = m_sources[OAM].data;
+    const uint8_t control = m_sources[CONTROL].data[0];
+    const bool tallSprites = control & 0x20;
+    
+    for (int i = 0; i < 64; ++i)
+    {
+        const uint8_t tile = oam[(i * 4) + 1];
+        const uint8_t attributes = oam[(i * 4) + 2];
+        const bool flipH = attributes & 0x40;
+        const bool flipV = attributes & 0x80;
+        const uint8_t paletteBase = 0x10 | ((attributes & 0x03) << 2);
+        
+        const int cellX = (i % 8) * 8;
+        const int cellY = (i / 8) * 16;
+        
+        if (tallSprites)
+        {
+            // 8x16 sprites take their pattern table from bit 0 of the tile index, and flip both halves vertically
+            uint16_t top = ((tile & 0x01) ? 0x1000 : 0x0000) + ((tile & 0xFE) * 16);
+            uint16_t bottom = top + 16;
+            
+            if (flipV)
+                std::swap(top, bottom);
+            
+            drawTile(image, cellX, cellY, top, paletteBase, flipH, flipV);
+            drawTile(image, cellX, cellY + 8, bottom, paletteBase, flipH, flipV);
+        }
+        else
+        {
+            uint16_t patternBase = (control & 0x08) ? 0x1000 : 0x0000;
+            drawTile(image, cellX, cellY, patternBase + (tile * 16), paletteBase, flipH, flipV);
+        }
+    }
+}
+
+void PPUViewers::drawScrollWindow(ViewerImage& image, uint16_t t, uint8_t fineX) const
+{
+    const int scrollX = (((t >> 10) & 0x01) * 256) + ((t & 0x1F) * 8) + fineX;
+    const int scrollY = (((t >> 11) & 0x01) * 240) + (((t >> 5) & 0x1F) * 8) + ((t >> 12) & 0x07);
+    
+    auto outline = [&image](int x, int y)
+    {
+        uint8_t* pixel = image.rgba.data() + (static_cast<size_t>(y % 480) * 512 + (x % 512)) * 4;
+        pixel[0] = SCROLL_WINDOW_COLOR.r;
+        pixel[1] = SCROLL_WINDOW_COLOR.g;
+        pixel[2] = SCROLL_WINDOW_COLOR.b;
+    };
+    
+    for (int i = 0; i < 256; ++i)
+    {
+        outline(scrollX + i, scrollY);
+        outline(scrollX + i, scrollY + 239);
+    }
+    
+    for (int i = 0; i < 240; ++i)
+    {
+        outline(scrollX, scrollY + i);
+        outline(scrollX + 255, scrollY + i);
+    }
+}
@@ -0,0 +1,139 @@
+//
+//  viewers.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// LIB includes
+#include "PPU.hpp"
+
+/*
+ RGBA image produced by a viewer (4 bytes per pixel, alpha always 0xFF)
+ */
+struct ViewerImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+    uint64_t version = 0; // Bumped every time the image is redrawn, so a window only uploads it when it changed
+};
+
+/*
+ Debug viewers of the PPU state: nametables, pattern tables, palette and OAM
+ 
+ Nothing is hooked into the PPU. When a view is requested, the copies of the memory it is built from are brought
+ up to date, and the view is only redrawn if that memory changed. VRAM copies are kept between requests and only
+ the nametable bytes and CHR tiles the PPU stamped as written since the last request are read again, so a static
+ screen costs nothing to look at. Viewers that are open but not requested cost the emulation nothing.
+ 
+ Views read PPU memory directly, so they must be requested from the thread running the PPU (e.g. between frames).
+ */
+class PPUViewers
+{
+    // PPU state the views are built from
+    enum Source { NAMETABLES, CHR, PALETTE_RAM, OAM, CONTROL, SOURCE_COUNT };
+    
+    struct SourceCopy
+    {
+        std::vector<uint8_t> data;
+        uint64_t generation = 0; // Bumped every time data changes
+        uint64_t writeSeq = 0;   // VRAM write sequence the copy is up to date with
+        bool copied = false;     // Whether data was fully copied since the viewers were created or reset
+    };
+    
+    struct View
+    {
+        ViewerImage image;
+        std::array<uint64_t, SOURCE_COUNT> drawnWith {}; // Generation of each source the image was drawn from
+        bool drawn = false;
+    };
+    
+    const PPU& m_ppu;
+    
+    std::array<SourceCopy, SOURCE_COUNT> m_sources;
+    
+    View m_nametables;      // Without the scroll window
+    View m_patternTables;
+    View m_palette;
+    View m_oam;
+    
+    // Nametables with the scroll window drawn on top
+    ViewerImage m_nametablesWithScroll;
+    uint64_t m_scrollDrawnOn;   // Version of m_nametables the scroll window was drawn on
+    uint16_t m_scrollT;
+    uint8_t m_scrollX;
+
+public:
+    
+    PPUViewers(const PPU& ppu);
+    
+    /**
+     *  All four nametables (512x480), using the background pattern table selected in PPUCTRL
+     *
+     *  @param showScroll Outlines the 256x240 window that the scroll in internal register t and fine x points at
+     */
+    const ViewerImage& nametables(bool showScroll = true);
+    
+    /**
+     *  Both pattern tables side by side (256x128) under each of the 8 palettes, stacked vertically (256x1024)
+     */
+    const ViewerImage& patternTables();
+    
+    // The 32 palette RAM entries as 16x16 swatches, background palettes on the first row (256x32)
+    const ViewerImage& palette();
+    
+    /**
+     *  The 64 OAM entries in order, on an 8x8 grid of 8x16 cells (64x128). 8x8 sprites only fill the top of their cell.
+     */
+    const ViewerImage& oam();
+    
+    /**
+     *  Makes the next requests copy their sources in full. Needed when VRAM changed without PPUDATA writes
+     *  (e.g. a snapshot was loaded or CHR ROM was copied in), which the PPU doesn't stamp.
+     */
+    void reset();
+
+private:
+    
+    /**
+     *  Refreshes the copy of the sources a view depends on, and tells whether the view has to be redrawn
+     *
+     *  @param view View to check
+     *  @param sources Sources the view is drawn from
+     *  @return True if any of the sources changed since the view was last drawn
+     */
+    bool needsRedraw(View& view, std::initializer_list<Source> sources);
+    
+    // Updates the copy of a source from the PPU, bumping its generation if it differs from the previous copy
+    void refreshSource(Source source);
+    
+    // Reads a byte of VRAM from the copies ($0000-$2FFF and $3F00-$3F1F)
+    uint8_t vram(uint16_t addr) const;
+    
+    // Writes the RGBA color of a palette RAM entry at pixel (x, y) of an image
+    void plot(ViewerImage& image, int x, int y, uint8_t paletteEntry) const;
+    
+    /**
+     *  Draws one 8x8 tile of a pattern table into an image
+     *
+     *  @param tileAddr Address of the first byte of the tile in CHR
+     *  @param paletteBase First palette RAM entry of the palette to use (0x00-0x1C)
+     *  @param flipH Flip the tile horizontally
+     *  @param flipV Flip the tile vertically
+     */
+    void drawTile(ViewerImage& image, int x, int y, uint16_t tileAddr, uint8_t paletteBase,
+                  bool flipH = false, bool flipV = false) const;
+    
+    void drawNametables(ViewerImage& image) const;
+    void drawPatternTables(ViewerImage& image) const;
+    void drawPalette(ViewerImage& image) const;
+    void drawOAM(ViewerImage& image) const;
+    
+    // Outlines the scroll window (wrapping around the edges) on top of the nametables
+    void drawScrollWindow(ViewerImage& image, uint16_t t, uint8_t fineX) const;
+};
@@ -0,0 +1,192 @@
+//
+//  console.cpp
+//  emulator_6502
+//
+
+#include "console.hpp"
+#include "../PPU/pipeline.hpp"
+
+#include <algorithm>
+
+// Creates the PPU of a console, rendering on its own thread into renderMemory if there is one
+static std::unique_ptr<PPU> makePPU(Memory& memory, Memory* renderMemory, VideoSink* sink)
+{
+    if (renderMemory)
+        return std::make_unique<PipelinedPPU>(memory, *renderMemory, sink);
+    
+    return std::make_unique<PPU>(memory, sink);
+}
+
+template <typename Timing>
+Console<Timing>::Console(NametableMirroring mirroring, VideoSink* sink, PPUMode ppuMode)
+    : m_ppuMemory(mirroring),
+      m_renderMemory(ppuMode == PPUMode::PIPELINED ? std::make_unique<PPUMemory>(mirroring) : nullptr),
+      m_ppu(makePPU(m_ppuMemory, m_renderMemory.get(), sink)), m_cpuMemory(m_ppu.get()), m_cpu(m_cpuMemory),
+      m_hashLog(nullptr), m_frameOutput(true)
+{
+    m_ppu->setRegion(Timing::REGION);
+    m_cpuMemory.setRegion(Timing::REGION);
+    m_ppu->setScheduler(&m_scheduler);
+    m_cpuMemory.setControllers(&m_controllers);
+}
+
+template <typename Timing>
+void Console<Timing>::runCycles(uint64_t cycles)
+{
+    run(m_cpu.cycleCount + cycles, false);
+}
+
+template <typename Timing>
+void Console<Timing>::runFrame()
+{
+    constexpr uint64_t cyclesPerFrame = dotsToCpuCycles<Timing>(Timing::DOTS_PER_SCANLINE * Timing::SCANLINES_PER_FRAME);
+    
+    run(m_cpu.cycleCount + (cyclesPerFrame * 2), true);
+}
+
+template <typename Timing>
+void Console<Timing>::run(uint64_t endCycle, bool stopAtFrameEnd)
+{
+    bool frameEnded = false;
+    
+    while (m_cpu.cycleCount < endCycle && !(stopAtFrameEnd && frameEnded))
+    {
+        // The PPU catches up on its own whenever a register is touched, so the CPU can run freely until the next event
+        uint64_t nextEventDot = m_scheduler.nextEventDot();
+        uint64_t untilCycle = endCycle;
+        
+        if (nextEventDot != Scheduler::NOT_SCHEDULED)
+        {
+            untilCycle = std::min(untilCycle, dotsToCpuCycles<Timing>(nextEventDot));
+        }
+        
+        m_cpu.run(untilCycle);
+        
+        uint64_t masterDot = cpuCyclesToDots<Timing>(m_cpu.cycleCount);
+        EventType event;
+        
+        while (m_scheduler.popDue(masterDot, event))
+        {
+            switch (event)
+            {
+                case EventType::FRAME_END:
+                    [[fallthrough]];
+                case EventType::NMI:
+                    [[fallthrough]];
+                case EventType::SPRITE_ZERO_HIT:
+                    m_ppu->catchUp(masterDot);
+                    break;
+                
+                // No APU or mapper yet to post these
+                default:
+                    break;
+            }
+        }
+        
+        // Picked up from the PPU rather than from the event: the PPU may have passed the end of the frame during a
+        // register access, after which the event was already reposted for the next frame
+        if (m_ppu->pollFrameEnd())
+        {
+            frameEnded = true;
+            
+            if (m_frameOutput)
+            {
+                if (m_hashLog)
+                    m_hashLog->record(m_ppu->getFrame());
+                
+                // Hands the frame to the sink (with an AsyncVideoSink, this never waits on the window)
+                m_ppu->updateScreen();
+            }
+        }
+        
+        if (m_ppu->pollNMI())
+        {
+            m_cpu.interrupt_handler(InterruptType::NMI);
+        }
+    }
+}
+
+template <typename Timing>
+Region Console<Timing>::getRegion() const
+{
+    return Timing::REGION;
+}
+
+template <typename Timing>
+void Console<Timing>::setFrameHashLog(FrameHashLog* log)
+{
+    m_hashLog = log;
+}
+
+template <typename Timing>
+void Console<Timing>::setFrameOutput(bool enabled)
+{
+    m_frameOutput = enabled;
+}
+
+template <typename Timing>
+void Console<Timing>::saveState(ConsoleState& state) const
+{
+    m_cpu.saveState(state.cpu);
+    m_ppu->saveState(state.ppu);
+    m_cpuMemory.saveContents(state.cpuMemory);
+    m_ppuMemory.saveContents(state.ppuMemory);
+    state.scheduler = m_scheduler;
+    state.controllers = m_controllers.getState();
+}
+
+template <typename Timing>
+void Console<Timing>::loadState(const ConsoleState& state)
+{
+    // VRAM goes first: a pipelined PPU copies it into the render thread's VRAM when it loads its state
+    m_cpu.loadState(state.cpu);
+    m_cpuMemory.loadContents(state.cpuMemory);
+    m_ppuMemory.loadContents(state.ppuMemory);
+    m_ppu->loadState(state.ppu);
+    m_scheduler = state.scheduler;
+    m_controllers.setState(state.controllers);
+}
+
+template <typename Timing>
+cpu6502& Console<Timing>::getCPU()
+{
+    return m_cpu;
+}
+
+template <typename Timing>
+PPU& Console<Timing>::getPPU()
+{
+    return *m_ppu;
+}
+
+template <typename Timing>
+Scheduler& Console<Timing>::getScheduler()
+{
+    return m_scheduler;
+}
+
+template <typename Timing>
+ControllerPorts& Console<Timing>::getControllers()
+{
+    return m_controllers;
+}
+
+template class Console<NTSCTiming>;
+template class Console<PALTiming>;
+template class Console<DendyTiming>;
+
+std::unique_ptr<ConsoleBase> makeConsole(const Header& header, VideoSink* sink, PPUMode ppuMode)
+{
+    NametableMirroring mirroring = NametableMirroring::NONE; // Four screen
+    
+    if (!header.flags.F)
+        mirroring = header.flags.M ? NametableMirroring::VERTICAL : NametableMirroring::HORIZONTAL;
+    
+    // Only NES 2.0 headers have a timing field. iNES 1.0 byte 12 is padding, often junk (e.g. "DiskDude!" dumps)
+    const Region region = header.format.nes2_0 ? static_cast<Region>(header.timingMode) : Region::NTSC;
+    
+    return withRegionTiming(region, [&](auto timing) -> std::unique_ptr<ConsoleBase>
+    {
+        return std::make_unique<Console<decltype(timing)>>(mirroring, sink, ppuMode);
+    });
+}
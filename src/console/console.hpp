@@ -0,0 +1,155 @@
+//
+//  console.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// LIB includes
+#include "../CPU/6502emu.hpp"
+#include "../PPU/PPU.hpp"
+#include "../util/cpumem.hpp"
+#include "../util/ppumem.hpp"
+#include "../util/scheduler.hpp"
+#include "../util/region.hpp"
+#include "../loader/rom_params.hpp"
+#include "../PPU/framehash.hpp"
+#include "../input/controller.hpp"
+
+/*
+ Where the PPU renders: inline on the thread running the console, or on a thread of its own (see PipelinedPPU)
+ */
+enum class PPUMode
+{
+    INLINE,
+    PIPELINED
+};
+
+/*
+ Snapshot of a whole console (see ConsoleBase::saveState). Reusing one snapshot avoids reallocating its buffers.
+ */
+struct ConsoleState
+{
+    CPUState cpu;
+    PPUState ppu;
+    std::vector<uint8_t> cpuMemory;
+    std::vector<uint8_t> ppuMemory;
+    Scheduler scheduler;
+    ControllerPorts::State controllers;
+};
+
+/*
+ Region independent interface of a console, for code that only knows the region at runtime
+ */
+class ConsoleBase
+{
+public:
+    virtual ~ConsoleBase() = default;
+    
+    /**
+     *  Runs the console for a number of CPU cycles, servicing scheduled events and NMIs along the way
+     *
+     *  @param cycles CPU cycles to run for (may overshoot by the length of the last instruction)
+     */
+    virtual void runCycles(uint64_t cycles) = 0;
+    
+    /**
+     *  Runs the console until the PPU completes the visible part of the next frame (gives up after two frames'
+     *  worth of cycles, e.g. if the PPU posts no events)
+     */
+    virtual void runFrame() = 0;
+    
+    virtual Region getRegion() const = 0;
+    
+    /**
+     *  Records the hash of every frame the PPU completes into a log, for comparing runs (nullptr to stop)
+     */
+    virtual void setFrameHashLog(FrameHashLog* log) = 0;
+    
+    /**
+     *  Chooses whether completed frames are hashed and presented (on by default). Run-ahead turns it off for the
+     *  frames the user shouldn't see.
+     */
+    virtual void setFrameOutput(bool enabled) = 0;
+    
+    /**
+     *  Copies/restores the state of the CPU, PPU, both memories, the scheduler and the controllers. Takes tens of microseconds,
+     *  so it can be done every frame. Only valid between runCycles()/runFrame() calls.
+     */
+    virtual void saveState(ConsoleState& state) const = 0;
+    virtual void loadState(const ConsoleState& state) = 0;
+    
+    virtual cpu6502& getCPU() = 0;
+    virtual PPU& getPPU() = 0;
+    virtual Scheduler& getScheduler() = 0;
+    
+    // Controller ports, to plug an InputQueue in or set buttons directly
+    virtual ControllerPorts& getControllers() = 0;
+};
+
+/*
+ CPU, PPU, their memories, and the scheduler that drives them, wired together for one region
+ 
+ The main loop is instantiated per region, so conversions between CPU cycles and PPU dots use constant clock ratios.
+ */
+template <typename Timing>
+class Console : public ConsoleBase
+{
+    PPUMemory m_ppuMemory;
+    std::unique_ptr<PPUMemory> m_renderMemory;  // VRAM of the render thread (pipelined PPU only)
+    std::unique_ptr<PPU> m_ppu;
+    CPUMemory m_cpuMemory;
+    cpu6502 m_cpu;
+    Scheduler m_scheduler;
+    ControllerPorts m_controllers;
+    
+    FrameHashLog* m_hashLog;
+    bool m_frameOutput;
+
+public:
+    
+    /**
+     *  @param mirroring Nametable mirroring of the cartridge
+     *  @param sink Sink the PPU presents to (can be nullptr)
+     *  @param ppuMode Whether the PPU renders on its own thread
+     */
+    Console(NametableMirroring mirroring, VideoSink* sink, PPUMode ppuMode = PPUMode::INLINE);
+    
+    void runCycles(uint64_t cycles) override;
+    void runFrame() override;
+    
+    Region getRegion() const override;
+    
+    void setFrameHashLog(FrameHashLog* log) override;
+    void setFrameOutput(bool enabled) override;
+    
+    void saveState(ConsoleState& state) const override;
+    void loadState(const ConsoleState& state) override;
+    
+    cpu6502& getCPU() override;
+    PPU& getPPU() override;
+    Scheduler& getScheduler() override;
+    ControllerPorts& getControllers() override;
+
+private:
+    
+    /**
+     *  Main loop: runs up to endCycle, servicing scheduled events and NMIs along the way
+     *
+     *  @param stopAtFrameEnd Returns early once the PPU completed a frame
+     */
+    void run(uint64_t endCycle, bool stopAtFrameEnd);
+};
+
+/**
+ *  Creates the console instantiation matching the timing mode and nametable layout of a ROM header
+ *
+ *  @param header Header of the loaded ROM
+ *  @param sink Sink the PPU presents to (can be nullptr)
+ *  @param ppuMode Whether the PPU renders on its own thread
+ */
+std::unique_ptr<ConsoleBase> makeConsole(const Header& header, VideoSink* sink, PPUMode ppuMode = PPUMode::INLINE);
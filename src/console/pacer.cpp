@@ -0,0 +1,130 @@
+//
+//  pacer.cpp
+//  emulator_6502
+//
+
+#include "pacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+FramePacer::FramePacer(double framesPerSecond)
+    : m_period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond))),
+      m_framesSinceOrigin(0), m_started(false), m_audio(nullptr), m_targetFill(0), m_maxDeviation(0.0),
+      m_smoothedFill(0.0)
+{
+    m_stats.averageFrameMs = std::chrono::duration<double, std::milli>(m_period).count();
+}
+
+void FramePacer::setAudioOutput(AudioOutput* audio, size_t targetFill, double maxDeviation)
+{
+    m_audio = audio;
+    m_targetFill = std::max<size_t>(targetFill, 1);
+    m_maxDeviation = maxDeviation;
+    m_smoothedFill = static_cast<double>(m_targetFill);
+    
+    reset();
+}
+
+void FramePacer::waitForNextFrame()
+{
+    if (!m_started)
+    {
+        const Clock::time_point now = Clock::now();
+        
+        m_started = true;
+        m_deadline = now;
+        m_lastFrame = now;
+        m_origin = now;
+        m_framesSinceOrigin = 0;
+        return;
+    }
+    
+    if (m_audio)
+        waitForAudio();
+    else
+        waitForClock(Clock::now());
+    
+    updateStats(Clock::now());
+}
+
+void FramePacer::reset()
+{
+    m_started = false;
+    m_stats.resampleRatio = 1.0;
+}
+
+double FramePacer::getResampleRatio() const
+{
+    return m_stats.resampleRatio;
+}
+
+const PacingStats& FramePacer::getStats() const
+{
+    return m_stats;
+}
+
+void FramePacer::waitForClock(Clock::time_point now)
+{
+    m_deadline += m_period;
+    
+    // Too far behind (stalled window, breakpoint): start a new schedule rather than rushing through the backlog
+    if (now - m_deadline > m_period * MAX_BACKLOG_FRAMES)
+    {
+        m_deadline = now;
+        m_origin = now - m_period;
+        m_framesSinceOrigin = 0;
+        ++m_stats.resyncs;
+        return;
+    }
+    
+    std::this_thread::sleep_until(m_deadline);
+}
+
+void FramePacer::waitForAudio()
+{
+    const uint32_t rate = m_audio->sampleRate();
+    const Clock::time_point giveUp = Clock::now() + (m_period * 2);
+    
+    // Sleep for as long as the excess takes to play, then check again (the card drains in bursts)
+    size_t queued = m_audio->queuedSamples();
+    
+    while (queued > m_targetFill && rate)
+    {
+        const auto excess = std::chrono::duration<double>(static_cast<double>(queued - m_targetFill) / rate);
+        const Clock::time_point wake = std::min(Clock::now() + std::chrono::duration_cast<Clock::duration>(excess), giveUp);
+        
+        std::this_thread::sleep_until(wake);
+        
+        // The output stopped draining (paused device): don't hang the loop on it
+        if (wake == giveUp)
+            break;
+        
+        queued = m_audio->queuedSamples();
+    }
+    
+    // Dynamic rate control: steer the queue back to the target with a ratio proportional to the error
+    m_smoothedFill += SMOOTHING * (static_cast<double>(queued) - m_smoothedFill);
+    
+    const double error = std::clamp((static_cast<double>(m_targetFill) - m_smoothedFill) / m_targetFill, -1.0, 1.0);
+    const size_t capacity = m_audio->capacity();
+    
+    m_stats.resampleRatio = 1.0 + (error * m_maxDeviation);
+    m_stats.bufferFill = capacity ? static_cast<double>(queued) / capacity : 0.0;
+}
+
+void FramePacer::updateStats(Clock::time_point now)
+{
+    const double frameMs = std::chrono::duration<double, std::milli>(now - m_lastFrame).count();
+    const double periodMs = std::chrono::duration<double, std::milli>(m_period).count();
+    
+    m_lastFrame = now;
+    ++m_framesSinceOrigin;
+    ++m_stats.frames;
+    
+    m_stats.lastFrameMs = frameMs;
+    m_stats.averageFrameMs += SMOOTHING * (frameMs - m_stats.averageFrameMs);
+    m_stats.jitterMs += SMOOTHING * (std::abs(frameMs - periodMs) - m_stats.jitterMs);
+    m_stats.driftMs = std::chrono::duration<double, std::milli>(now - m_origin).count() - (m_framesSinceOrigin * periodMs);
+}
@@ -0,0 +1,114 @@
+//
+//  pacer.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+
+/*
+ Fill level of an audio output, which the pacer can follow instead of the system clock
+ 
+ Implemented by the audio backend: the sound card drains the queue at its own rate, so keeping the queue at a
+ fixed depth makes video follow the audio clock and audio never underruns.
+ */
+class AudioOutput
+{
+public:
+    virtual ~AudioOutput() = default;
+    
+    // Samples queued and not played yet
+    virtual size_t queuedSamples() const = 0;
+    
+    // Samples the queue can hold
+    virtual size_t capacity() const = 0;
+    
+    virtual uint32_t sampleRate() const = 0;
+};
+
+/*
+ Timing metrics of the main loop
+ */
+struct PacingStats
+{
+    uint64_t frames = 0;
+    uint64_t resyncs = 0;           // Times the loop fell too far behind and dropped its backlog
+    double lastFrameMs = 0.0;       // Wall time between the last two frames
+    double averageFrameMs = 0.0;    // Moving average of the frame time
+    double jitterMs = 0.0;          // Moving average of the distance between the frame time and the nominal period
+    double bufferFill = 0.0;        // Audio queue fill level, 0 to 1 (0 without audio)
+    double resampleRatio = 1.0;     // Ratio the audio resampler should apply (see FramePacer::getResampleRatio())
+    double driftMs = 0.0;           // Wall time minus emulated time since the last resync
+};
+
+/*
+ Paces the main loop to the console's frame rate, sleeping between frames instead of spinning
+ 
+ Without audio, frames are started on a fixed schedule of the system clock. With an AudioOutput, each frame
+ waits until the audio queue drains to its target depth, and a resampling ratio within maxDeviation of 1 is
+ derived from how far the queue is from that depth (dynamic rate control): producing slightly more samples
+ when the queue is low and fewer when it is high keeps it from drifting, in amounts too small to hear.
+ */
+class FramePacer
+{
+    using Clock = std::chrono::steady_clock;
+    
+    // Frames the loop may fall behind before the schedule is reset instead of catching up
+    static constexpr int MAX_BACKLOG_FRAMES = 4;
+    
+    // Weight of the newest sample in the moving averages
+    static constexpr double SMOOTHING = 0.05;
+    
+    Clock::duration m_period;
+    Clock::time_point m_deadline;
+    Clock::time_point m_lastFrame;
+    Clock::time_point m_origin;
+    uint64_t m_framesSinceOrigin;
+    bool m_started;
+    
+    AudioOutput* m_audio;
+    size_t m_targetFill;
+    double m_maxDeviation;
+    double m_smoothedFill;
+    
+    PacingStats m_stats;
+
+public:
+    
+    /**
+     *  @param framesPerSecond Frame rate to pace to (see framesPerSecond<Timing>())
+     */
+    FramePacer(double framesPerSecond);
+    
+    /**
+     *  Follows an audio queue instead of the system clock (nullptr goes back to the clock)
+     *
+     *  @param targetFill Queue depth to keep, in samples (latency of the audio)
+     *  @param maxDeviation Largest change of the resampling ratio (0.005 is inaudible)
+     */
+    void setAudioOutput(AudioOutput* audio, size_t targetFill, double maxDeviation = 0.005);
+    
+    // Sleeps until the next frame should start, then updates the stats
+    void waitForNextFrame();
+    
+    // Forgets the schedule (e.g. after a pause), so the next frame starts immediately
+    void reset();
+    
+    /**
+     *  Samples the audio resampler should output per input sample, relative to the nominal rate
+     *
+     *  @return 1 without audio, otherwise within maxDeviation of 1
+     */
+    double getResampleRatio() const;
+    
+    const PacingStats& getStats() const;
+
+private:
+    
+    void waitForClock(Clock::time_point now);
+    void waitForAudio();
+    void updateStats(Clock::time_point now);
+};
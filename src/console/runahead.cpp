@@ -0,0 +1,58 @@
+//
+//  runahead.cpp
+//  emulator_6502
+//
+
+#include "runahead.hpp"
+
+#include <algorithm>
+
+RunAhead::RunAhead(ConsoleBase& console, int frames)
+    : m_console(console), m_frames(std::max(frames, 0)), m_state(std::make_unique<ConsoleState>()) {}
+
+void RunAhead::setFrames(int frames)
+{
+    m_frames = std::max(frames, 0);
+}
+
+int RunAhead::getFrames() const
+{
+    return m_frames;
+}
+
+void RunAhead::runFrame()
+{
+    PPU& ppu = m_console.getPPU();
+    
+    if (m_frames == 0)
+    {
+        ppu.setFrameRendering(true);
+        m_console.setFrameOutput(true);
+        m_console.runFrame();
+        return;
+    }
+    
+    // The real frame: the one the emulation keeps, but nobody sees
+    ppu.setFrameRendering(false);
+    m_console.setFrameOutput(false);
+    m_console.runFrame();
+    
+    m_console.saveState(*m_state);
+    
+    // Speculative frames: only the last one is composed and presented, and they all see the input of the real one
+    m_console.getControllers().setQueueFrozen(true);
+    
+    for (int frame = 1; frame <= m_frames; ++frame)
+    {
+        const bool last = (frame == m_frames);
+        
+        ppu.setFrameRendering(last);
+        m_console.setFrameOutput(last);
+        m_console.runFrame();
+    }
+    
+    // The frame buffer isn't part of the state, so it keeps the presented frame for the next comparison
+    m_console.loadState(*m_state);
+    m_console.getControllers().setQueueFrozen(false);
+    m_console.setFrameOutput(true);
+}
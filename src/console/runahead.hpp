@@ -0,0 +1,44 @@
+//
+//  runahead.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+
+// LIB includes
+#include "console.hpp"
+
+/*
+ Run-ahead: hides the frames of input lag games build into their main loop
+ 
+ Each displayed frame, the console first runs the real frame (render-less, nothing presented), then saves its
+ state, runs the given number of frames further with the same input, presents only the last one, and restores
+ the state. The player sees the game as it will be a few frames from now, while the emulation itself never gets
+ ahead. Only the presented frame is composed: the others run in skip mode, which keeps every side effect.
+ */
+class RunAhead
+{
+    ConsoleBase& m_console;
+    int m_frames;
+    
+    // Kept between frames so the snapshot buffers are only allocated once
+    std::unique_ptr<ConsoleState> m_state;
+
+public:
+    
+    /**
+     *  @param console Console to drive
+     *  @param frames Frames to run ahead (0 runs the console normally)
+     */
+    RunAhead(ConsoleBase& console, int frames);
+    
+    // Frames to run ahead, usually the number of lag frames of the game (1-3)
+    void setFrames(int frames);
+    int getFrames() const;
+    
+    // Runs one displayed frame, with the input currently held by the controller
+    void runFrame();
+};
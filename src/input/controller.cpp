@@ -0,0 +1,124 @@
+//
+//  controller.cpp
+//  emulator_6502
+//
+
+#include "controller.hpp"
+
+#include <chrono>
+
+/* ---------- INPUT QUEUE ---------- */
+
+InputQueue::InputQueue(InputClock clock) : m_clock(clock) {}
+
+InputClock InputQueue::getClock() const
+{
+    return m_clock;
+}
+
+bool InputQueue::push(const InputEvent& event)
+{
+    return m_events.push(event);
+}
+
+bool InputQueue::pop(InputEvent& event)
+{
+    return m_events.pop(event);
+}
+
+uint64_t InputQueue::hostTime()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+/* ---------- CONTROLLER PORTS ---------- */
+
+ControllerPorts::ControllerPorts() : m_queue(nullptr), m_queueFrozen(false), m_pending {}, m_hasPending(false) {}
+
+void ControllerPorts::setQueue(InputQueue* queue)
+{
+    m_queue = queue;
+    m_hasPending = false;
+}
+
+void ControllerPorts::setQueueFrozen(bool frozen)
+{
+    m_queueFrozen = frozen;
+}
+
+void ControllerPorts::setButtons(int port, uint8_t buttons)
+{
+    m_state.buttons[port & 1] = buttons;
+    
+    if (m_state.strobe)
+        reload();
+}
+
+uint8_t ControllerPorts::getButtons(int port) const
+{
+    return m_state.buttons[port & 1];
+}
+
+void ControllerPorts::writeStrobe(uint8_t value, uint64_t cycle)
+{
+    const bool strobe = value & 1;
+    
+    // Events are applied right before the buttons get latched, as late as the game allows
+    applyEvents(cycle);
+    
+    // The registers reload continuously while the strobe is high, and keep the last value once it goes low
+    if (strobe || m_state.strobe)
+        reload();
+    
+    m_state.strobe = strobe;
+}
+
+uint8_t ControllerPorts::read(int port)
+{
+    uint8_t& shift = m_state.shift[port & 1];
+    
+    if (m_state.strobe)
+        return m_state.buttons[port & 1] & BUTTON_A;
+    
+    // Official controllers shift in 1s, so reads after the 8th return 1
+    const uint8_t bit = shift & 1;
+    shift = 0x80 | (shift >> 1);
+    return bit;
+}
+
+const ControllerPorts::State& ControllerPorts::getState() const
+{
+    return m_state;
+}
+
+void ControllerPorts::setState(const State& state)
+{
+    m_state = state;
+}
+
+void ControllerPorts::applyEvents(uint64_t cycle)
+{
+    if (!m_queue || m_queueFrozen)
+        return;
+    
+    const uint64_t now = (m_queue->getClock() == InputClock::HOST) ? InputQueue::hostTime() : cycle;
+    
+    while (m_hasPending || m_queue->pop(m_pending))
+    {
+        m_hasPending = true;
+        
+        if (m_pending.time > now)
+            return;
+        
+        uint8_t& buttons = m_state.buttons[m_pending.port & 1];
+        buttons = m_pending.pressed ? (buttons | m_pending.buttons) : (buttons & ~m_pending.buttons);
+        
+        m_hasPending = false;
+    }
+}
+
+void ControllerPorts::reload()
+{
+    m_state.shift = m_state.buttons;
+}
@@ -0,0 +1,151 @@
+//
+//  controller.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+
+// LIB includes
+#include "../util/ringbuffer.hpp"
+
+// Buttons of a standard controller, in the order the shift register reports them
+enum Button : uint8_t
+{
+    BUTTON_A      = 0x01,
+    BUTTON_B      = 0x02,
+    BUTTON_SELECT = 0x04,
+    BUTTON_START  = 0x08,
+    BUTTON_UP     = 0x10,
+    BUTTON_DOWN   = 0x20,
+    BUTTON_LEFT   = 0x40,
+    BUTTON_RIGHT  = 0x80
+};
+
+// What the time of the events in a queue is measured in
+enum class InputClock
+{
+    HOST,       // Nanoseconds of the host's steady clock (live input, see InputQueue::hostTime())
+    CPU_CYCLES  // CPU cycles since power up (scripted input and replays)
+};
+
+/*
+ Buttons pressed or released on one controller at a point in time
+ */
+struct InputEvent
+{
+    uint64_t time;
+    uint8_t port;       // 0: $4016, 1: $4017
+    uint8_t buttons;    // Button mask
+    bool pressed;
+};
+
+/*
+ Lock-free queue of timestamped input events, from an input thread (or a script) to the emulation thread
+ 
+ The producer pushes events in time order. The console applies them when the game strobes $4016, so each read
+ sees the buttons as they were at that exact moment instead of when the frame started.
+ */
+class InputQueue
+{
+    RingBuffer<InputEvent, 1024> m_events;
+    InputClock m_clock;
+
+public:
+    
+    InputQueue(InputClock clock = InputClock::HOST);
+    
+    InputClock getClock() const;
+    
+    /**
+     *  Queues an event (producer only)
+     *
+     *  @return False if the queue is full (the emulation thread isn't strobing the controllers)
+     */
+    bool push(const InputEvent& event);
+    
+    // Takes the oldest event (consumer only)
+    bool pop(InputEvent& event);
+    
+    // Current time of the host clock, to timestamp live events
+    static uint64_t hostTime();
+};
+
+/*
+ The two controller ports ($4016/$4017), with standard controllers plugged in
+ 
+ Writing 1 to bit 0 of $4016 holds both shift registers in reload; writing 0 latches the buttons, which are then
+ read one bit per read of the port (A, B, Select, Start, Up, Down, Left, Right, then 1s).
+ */
+class ControllerPorts
+{
+public:
+    
+    /*
+     Registers of both controllers, for snapshots
+     */
+    struct State
+    {
+        std::array<uint8_t, 2> buttons {};
+        std::array<uint8_t, 2> shift {};
+        bool strobe = false;
+    };
+
+private:
+    
+    State m_state;
+    
+    InputQueue* m_queue;
+    bool m_queueFrozen;
+    
+    // Event taken from the queue that isn't due yet
+    InputEvent m_pending;
+    bool m_hasPending;
+
+public:
+    
+    ControllerPorts();
+    
+    /**
+     *  Sets where input comes from (nullptr to only use setButtons())
+     */
+    void setQueue(InputQueue* queue);
+    
+    /**
+     *  Stops taking events from the queue, so the buttons stay as they are. Run-ahead freezes input while it runs
+     *  its speculative frames, which would otherwise consume events that are lost when the state is restored.
+     */
+    void setQueueFrozen(bool frozen);
+    
+    // Sets the held buttons of a controller directly
+    void setButtons(int port, uint8_t buttons);
+    uint8_t getButtons(int port) const;
+    
+    /**
+     *  Write to $4016
+     *
+     *  @param value Value written (only bit 0, the strobe, is used)
+     *  @param cycle CPU cycle of the write, for queues timed in CPU cycles
+     */
+    void writeStrobe(uint8_t value, uint64_t cycle);
+    
+    /**
+     *  Read of $4016 (port 0) or $4017 (port 1)
+     *
+     *  @return Next button bit in bit 0 (the other bits are open bus on the hardware)
+     */
+    uint8_t read(int port);
+    
+    const State& getState() const;
+    void setState(const State& state);
+
+private:
+    
+    // Applies every queued event that is due at the given time
+    void applyEvents(uint64_t cycle);
+    
+    // Copies the buttons into the shift registers
+    void reload();
+};
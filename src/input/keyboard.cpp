@@ -0,0 +1,93 @@
+//
+//  keyboard.cpp
+//  emulator_6502
+//
+
+#include "keyboard.hpp"
+
+using Key = sf::Keyboard::Key;
+
+KeyboardInput::KeyboardInput(InputQueue& queue, int port, std::function<bool()> isActive)
+    : m_queue(queue), m_port(port), m_isActive(std::move(isActive)), m_running(false), m_held(0)
+{
+    m_bindings = {
+        { Key::X, BUTTON_A },
+        { Key::Z, BUTTON_B },
+        { Key::RShift, BUTTON_SELECT },
+        { Key::Enter, BUTTON_START },
+        { Key::Up, BUTTON_UP },
+        { Key::Down, BUTTON_DOWN },
+        { Key::Left, BUTTON_LEFT },
+        { Key::Right, BUTTON_RIGHT }
+    };
+}
+
+KeyboardInput::~KeyboardInput()
+{
+    stop();
+}
+
+void KeyboardInput::bind(Key key, Button button)
+{
+    for (auto& binding : m_bindings)
+    {
+        if (binding.second == button)
+        {
+            binding.first = key;
+            return;
+        }
+    }
+    
+    m_bindings.push_back({ key, button });
+}
+
+void KeyboardInput::start()
+{
+    if (m_running)
+        return;
+    
+    m_running = true;
+    m_thread = std::thread(&KeyboardInput::pollLoop, this);
+}
+
+void KeyboardInput::stop()
+{
+    if (!m_running)
+        return;
+    
+    m_running = false;
+    m_thread.join();
+}
+
+void KeyboardInput::pollLoop()
+{
+    auto nextPoll = std::chrono::steady_clock::now();
+    
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        uint8_t held = 0;
+        
+        if (!m_isActive || m_isActive())
+        {
+            for (const auto& [key, button] : m_bindings)
+            {
+                if (sf::Keyboard::isKeyPressed(key))
+                    held |= button;
+            }
+        }
+        
+        const uint64_t now = InputQueue::hostTime();
+        const uint8_t pressed = held & ~m_held;
+        const uint8_t released = m_held & ~held;
+        
+        // A change that doesn't fit in the queue is retried on the next poll
+        if (pressed && m_queue.push({ now, static_cast<uint8_t>(m_port), pressed, true }))
+            m_held |= pressed;
+        
+        if (released && m_queue.push({ now, static_cast<uint8_t>(m_port), released, false }))
+            m_held &= ~released;
+        
+        nextPoll += POLL_INTERVAL;
+        std::this_thread::sleep_until(nextPoll);
+    }
+}
@@ -0,0 +1,68 @@
+//
+//  keyboard.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// LIB includes
+#include "controller.hpp"
+
+// SFML includes
+#include <SFML/Window.hpp>
+
+/*
+ Input thread that samples the keyboard every millisecond and queues every change as a timestamped event
+ 
+ Window events are only polled between frames, on the thread that owns the window; sampling the key states on a
+ thread of its own timestamps presses to the millisecond, and the console applies them at the next $4016 strobe.
+ */
+class KeyboardInput
+{
+    static constexpr std::chrono::milliseconds POLL_INTERVAL { 1 };
+    
+    InputQueue& m_queue;
+    int m_port;
+    std::vector<std::pair<sf::Keyboard::Key, uint8_t>> m_bindings;
+    
+    // Whether keys should be read at all (e.g. only while the window has focus)
+    std::function<bool()> m_isActive;
+    
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    uint8_t m_held;
+
+public:
+    
+    /**
+     *  Binds the default keys: arrows, X (A), Z (B), right shift (Select), enter (Start)
+     *
+     *  @param queue Queue the events go to
+     *  @param port Controller the keys are for
+     *  @param isActive Called every poll, no key counts as held while it returns false (nullptr: always active)
+     */
+    KeyboardInput(InputQueue& queue, int port = 0, std::function<bool()> isActive = nullptr);
+    ~KeyboardInput();
+    
+    KeyboardInput(const KeyboardInput&) = delete;
+    KeyboardInput& operator=(const KeyboardInput&) = delete;
+    
+    // Binds a key to a button (only before start())
+    void bind(sf::Keyboard::Key key, Button button);
+    
+    void start();
+    void stop();
+
+private:
+    
+    // Body of the input thread
+    void pollLoop();
+};
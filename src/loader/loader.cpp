@@ -27,6 +27,11 @@ const bool Loader::isLoaded() const
     return m_romLoaded;
 }
 
+const Header& Loader::getHeader() const
+{
+    return *m_header;
+}
+
 void Loader::loadRom(const char* filename)
 {
     m_romLoaded = true;
@@ -34,6 +34,9 @@ public:
     
     const bool isLoaded() const;
     
+    // Header of the loaded ROM. Only valid while isLoaded()
+    const Header& getHeader() const;
+    
     void loadRom(const char* filename);
     void clearRom();
     
@@ -8,15 +8,28 @@
 #include <iostream>
 #include <fstream>
 #include <stdint.h>
+#include <chrono>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <thread>
 
 // Lib includes
 #include "CPU/6502emu.hpp"
 #include "PPU/PPU.hpp"
 #include "screen/gui.hpp"
+#include "screen/asyncsink.hpp"
+#include "screen/capture.hpp"
+#include "screen/sharedring.hpp"
+#include "screen/screenshot.hpp"
+#include "input/keyboard.hpp"
+#include "console/pacer.hpp"
 #include "loader/loader.hpp"
 
 #include "util/cpumem.hpp"
 #include "util/ppumem.hpp"
+#include "util/scheduler.hpp"
+#include "console/console.hpp"
 
 // SFML includes
 #include <SFML/Graphics.hpp>
@@ -51,260 +64,194 @@ void drawMario(GUI* gui)
     struct Pixel hair = {106, 107, 4};
     struct Pixel skin = {227, 157, 37};
     
-    int y = 0;
+    // B: background, C: clothes, H: hair, S: skin
+    constexpr int WIDTH = 12;
+    constexpr int HEIGHT = 16;
+    constexpr const char* SPRITE[HEIGHT] = {
+        "BBBBBBBBBBBB",
+        "BBBCCCCCBBBB",
+        "BBCCCCCCCCCB",
+        "BBHHHSSHSBBB",
+        "BHSHSSSHSSSB",
+        "BHSHHSSSHSSS",
+        "BHHSSSSHHHHB",
+        "BBBSSSSSSSBB",
+        "BBHHCHHHBBBB",
+        "BHHHCHHCHHHB",
+        "HHHHCCCCHHHH",
+        "SSHCSCCSCHSS",
+        "SSSCCCCCCSSS",
+        "SSCCCCCCCCSS",
+        "BBCCCBBCCCBB",
+        "BHHHBBBBHHHB",
+    };
+    
+    std::array<uint32_t, WIDTH * HEIGHT> pixels;
     
-    // Line 1
-    for (int i = 0; i < 12; i++)
+    for (int y = 0; y < HEIGHT; ++y)
     {
-        gui->drawPixel(i, y, background);
+        for (int x = 0; x < WIDTH; ++x)
+        {
+            Pixel color = background;
+            
+            switch (SPRITE[y][x])
+            {
+                case 'C': color = clothes; break;
+                case 'H': color = hair; break;
+                case 'S': color = skin; break;
+                default: break;
+            }
+            
+            std::memcpy(&pixels[(y * WIDTH) + x], &color, sizeof(color));
+        }
     }
     
-    y++;
+    // One bounds check and one copy per row, instead of per pixel
+    gui->writeRect(0, 0, WIDTH, HEIGHT, pixels.data(), WIDTH);
+}
+
+/*
+ Measures how long the PPU takes per frame on a static screen (a single nametable byte changes every frame),
+ with and without reusing the background tiles of the previous frame
+ */
+void benchmarkStaticScreen()
+{
+    constexpr int FRAMES = 600;
     
-    // Line 2
-    for (int i = 0; i < 12; i++)
+    for (bool caching : {false, true})
     {
-        if (i > 2 && i < 8)
-            gui->drawPixel(i, y, clothes);
-        else
-            gui->drawPixel(i, y, background);
+        PPUMemory ppuMem(NametableMirroring::VERTICAL);
+        PPU ppu(ppuMem, nullptr);
+        ppu.setBackgroundCaching(caching);
+        
+        // Fill pattern tables and nametables with noise so every tile is different
+        uint32_t seed = 0x12345678;
+        for (uint16_t addr = 0; addr < 0x3000; ++addr)
+        {
+            seed = seed * 1664525 + 1013904223;
+            ppuMem[addr] = seed >> 24;
+        }
+        ppu.invalidateBackgroundCache(); // Memory was written without going through PPUDATA
+        
+        ppu.write(0x2001, 0x0A); // Show background, including the leftmost 8 pixels
+        
+        auto start = std::chrono::steady_clock::now();
+        
+        for (int frame = 0; frame < FRAMES; ++frame)
+        {
+            // Update one tile, then reset the scroll like a game would during vblank
+            ppu.write(0x2006, 0x21);
+            ppu.write(0x2006, frame & 0xFF);
+            ppu.write(0x2007, frame);
+            ppu.write(0x2000, 0x10);
+            ppu.write(0x2005, 0);
+            ppu.write(0x2005, 0);
+            
+            ppu.step(PPU::DOTS_PER_SCANLINE * NTSCTiming::SCANLINES_PER_FRAME);
+        }
+        
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << (caching ? "Incremental" : "Full") << " background: " << elapsed.count() / FRAMES << " ms/frame\n";
     }
-    
-    // Line 3
-    
-    y++;
-    for (int i = 0; i < 12; i++)
+}
+
+int main(int argc, const char * argv[]) 
+{
+    // --headless presents to no window, for machines without a display
+    // --capture file records every frame instead (Y4M if the name ends in .y4m, raw RGB otherwise)
+    // --share name publishes every frame to a shared memory ring instead, for other processes (e.g. /nes_frames)
+    // --bench measures the PPU on a static screen and exits
+    // --pipelined-ppu renders on a thread of its own, next to the one running the CPU
+    bool headless = false;
+    PPUMode ppuMode = PPUMode::INLINE;
+    const char* captureFile = nullptr;
+    const char* shareName = nullptr;
+    
+    for (int i = 1; i < argc; ++i)
     {
-        if (i > 1 && i < 11)
-            gui->drawPixel(i, y, clothes);
-        else
-            gui->drawPixel(i, y, background);
+        if (std::string_view(argv[i]) == "--headless")
+            headless = true;
+        else if (std::string_view(argv[i]) == "--capture" && i + 1 < argc)
+            captureFile = argv[++i];
+        else if (std::string_view(argv[i]) == "--share" && i + 1 < argc)
+            shareName = argv[++i];
+        else if (std::string_view(argv[i]) == "--pipelined-ppu")
+            ppuMode = PPUMode::PIPELINED;
+        else if (std::string_view(argv[i]) == "--bench")
+        {
+            benchmarkStaticScreen();
+            return 0;
+        }
     }
     
-    // Line 4
+    VideoSink* game = nullptr;
+    GUI* window = nullptr;
     
-    y++;
-    int i = 0;
-    
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    
-    // Line 5
-    
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, background);
-    
-    // Line 6
-    
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    
-    // Line 7
-    
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, background);
-    
-    // Line 8
-    
-    y++;
-    for (int j = 0; j < 12; j++)
+    if (captureFile)
     {
-        if (j > 2 && j < 10)
-            gui->drawPixel(j, y, skin);
-        else
-            gui->drawPixel(j, y, background);
+        const bool y4m = std::string_view(captureFile).ends_with(".y4m");
+        VideoCapture* capture = new VideoCapture();
+        
+        if (!capture->start(captureFile, y4m ? CaptureFormat::Y4M : CaptureFormat::RAW_RGB))
+        {
+            std::cerr << "Could not open capture file " << captureFile << "\n";
+            delete capture;
+            return 1;
+        }
+        
+        game = capture;
+        headless = true;
     }
-    
-    // Line 9
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    
-    // Line 10
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, background);
-    
-    // Line 11
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    
-    // Line 12
-    y++;
-    i = 0;
-    
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, skin);
-    gui->drawPixel(i++, y, skin);
-    
-    // Line 13
-    
-    y++;
-    for (int j = 0; j < 12; j++)
+    else if (shareName)
     {
-        if (j > 2 && j < 9)
-            gui->drawPixel(j, y, clothes);
-        else
-            gui->drawPixel(j, y, skin);
+        SharedFrameRing* ring = new SharedFrameRing();
+        
+        if (!ring->create(shareName))
+        {
+            std::cerr << "Could not create shared frame ring " << shareName << "\n";
+            delete ring;
+            return 1;
+        }
+        
+        game = ring;
+        headless = true;
     }
-    
-    // Line 14
-    
-    y++;
-    for (int j = 0; j < 12; j++)
+    else
     {
-        if (j > 1 && j < 10)
-            gui->drawPixel(j, y, clothes);
-        else
-            gui->drawPixel(j, y, skin);
+        if (!headless)
+            window = new GUI();
+        
+        game = window ? static_cast<VideoSink*>(window) : new NullVideoSink();
     }
     
-    // Line 15
-    y++;
-    i = 0;
+    // With a window, the emulation runs on a worker thread and hands its frames over to the window's thread
+    std::unique_ptr<AsyncVideoSink> presenter;
     
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, clothes);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
+    if (window)
+        presenter = std::make_unique<AsyncVideoSink>(*window);
     
-    // Line 16
+    // Without a ROM loaded there is no header to pick the region from (see makeConsole)
+    Console<NTSCTiming> console(NametableMirroring::NONE, presenter ? presenter.get() : game, ppuMode);
+    cpu6502& cpu = console.getCPU();
     
-    y++;
-    i = 0;
+    // Keys are sampled on their own thread and reach the game at its next controller strobe (only with a window,
+    // which the thread asks for focus)
+    InputQueue input;
+    std::unique_ptr<KeyboardInput> keyboard;
     
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, background);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, hair);
-    gui->drawPixel(i++, y, background);
-}
-
-int main(int argc, const char * argv[]) 
-{
-    GUI* game = new GUI();
-    //drawMario(game);
-
-    while (game->running())
+    if (window)
     {
-        game->update();
-        game->render();
+        keyboard = std::make_unique<KeyboardInput>(input, 0, [window] { return window->hasFocus(); });
+        console.getControllers().setQueue(&input);
+        keyboard->start();
     }
     
-    PPUMemory* ppuMem = new PPUMemory(NametableMirroring::NONE);
-    PPU* ppu = new PPU(*ppuMem, game);
-    CPUMemory* cpuMem = new CPUMemory(ppu);
-    cpu6502* cpu = new cpu6502(*cpuMem);
+    // The built in palette is used unless a .pal file is given (--palette file.pal)
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (std::string_view(argv[i]) == "--palette")
+            console.getPPU().setPalette(Palette(argv[i + 1]));
+    }
     
     uint8_t program[] = {
         0xAD, 0x02, 0x20,  // LDA $2002 (Read PPU Status to clear w toggle)
@@ -322,39 +269,82 @@ int main(int argc, const char * argv[])
         0xD0, 0xF9,        // BNE -9         (Branch to STA $2007 if Y < 30)
         0xE8,              // INX            (Increment X)
         0xE0, 0x20,        // CPX #$20       (Compare X with 32)
-        0xD0, 0xEF         // BNE -17        (Branch to LDY #$00 if X < 32)
+        0xD0, 0xEF,        // BNE -17        (Branch to LDY #$00 if X < 32)
+        
+        0x4C, 0x20, 0x00   // JMP $0020      (Idle once done, while the window keeps running frames)
     };
     
     uint16_t counter { 0 };
     
     for (auto const opcode : program)
     {
-        cpu->memory[counter] = opcode;
+        cpu.memory[counter] = opcode;
         counter++;
     }
     
     //std::string filepath = "./roms/Donkey Kong (Japan).nes";
-    //readFile(cpu, filepath, 0x8000);
-    cpu->pc.val = 0;
-    int cycles = 0;
+    //readFile(&cpu, filepath, 0x8000);
+    cpu.pc.val = 0;
+    
+    if (window)
+    {
+        // One emulated frame per paced iteration, at the console's frame rate (the pacer sleeps in between)
+        std::thread emulation([&console, &presenter]
+        {
+            FramePacer pacer(framesPerSecond<NTSCTiming>());
+            
+            while (presenter->running())
+            {
+                pacer.waitForNextFrame();
+                console.runFrame();
+            }
+        });
+        
+        // The window is created, polled and drawn on the main thread only
+        while (window->running())
+        {
+            window->update();
+            
+            // Wakes up on every new frame, or often enough to keep handling events when there is none
+            if (presenter->waitForFrame(std::chrono::milliseconds(16)))
+                presenter->presentLatest();
+            
+            window->render();
+        }
+        
+        presenter->close();
+        emulation.join();
+    }
+    else
+    {
+        // Roughly the length of the program above (32 * 30 PPUDATA writes)
+        console.runCycles(11100);
+    }
+    
+    std::cout << std::hex << static_cast<int>(cpu.memory[0x2006]) << std::dec << "\n";
+    console.getPPU().debug();
     
-    for (int i = 0; i < (6 + 6 * 32 + 4 * (960)); i++)
+    // --screenshot file.png saves the last frame (encoded on a background thread, written before exiting)
+    for (int i = 1; i + 1 < argc; ++i)
     {
-        cycles += cpu->emulate();
+        if (std::string_view(argv[i]) == "--screenshot")
+        {
+            ScreenshotWriter screenshots;
+            screenshots.capture(console.getPPU().getFrame(), console.getPPU().getPalette(), argv[i + 1]);
+            screenshots.flush();
+        }
     }
     
-    std::cout << std::hex << static_cast<int>(cpu->memory[0x2006]) << std::dec << "\n";
-    ppu->debug();
+    // The input thread uses the window until it is joined
+    keyboard.reset();
+    presenter.reset();
     
-    delete cpu;
-    delete cpuMem;
     delete game;
-    delete ppu;
-    delete ppuMem;
     
     /*
     Loader loader = Loader();
     loader.loadRom("/Users/kylechiem/Documents/VSCode Projects/c++/xcodejawn/emulator_6502/emulator_6502/roms/Donkey Kong (Japan).nes");
+    std::unique_ptr<ConsoleBase> console = makeConsole(loader.getHeader(), game);
      */
     
     
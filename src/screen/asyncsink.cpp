@@ -0,0 +1,62 @@
+//
+//  asyncsink.cpp
+//  emulator_6502
+//
+
+#include "asyncsink.hpp"
+
+AsyncVideoSink::AsyncVideoSink(VideoSink& target)
+    : m_target(target), m_lastFrameNumber(0), m_framesDropped(0), m_running(true) {}
+
+/* ---------- EMULATION THREAD ---------- */
+
+void AsyncVideoSink::presentFrame(const FrameBuffer& frame, const Palette& palette)
+{
+    if (frame.frameNumber != 0 && frame.frameNumber == m_lastFrameNumber)
+        return;
+    
+    m_lastFrameNumber = frame.frameNumber;
+    
+    Slot& slot = m_frames.back();
+    slot.frame = frame;
+    slot.palette = palette;
+    
+    if (!m_frames.publish())
+        m_framesDropped.fetch_add(1, std::memory_order_relaxed);
+    
+    // Not taking the mutex keeps this wait free. A missed wake up only delays the frame until the timeout
+    m_wake.notify_one();
+}
+
+bool AsyncVideoSink::running() const
+{
+    return m_running.load(std::memory_order_acquire);
+}
+
+/* ---------- WINDOW THREAD ---------- */
+
+bool AsyncVideoSink::waitForFrame(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    return m_wake.wait_for(lock, timeout, [this] { return m_frames.hasNew(); });
+}
+
+bool AsyncVideoSink::presentLatest()
+{
+    if (!m_frames.update())
+        return false;
+    
+    const Slot& slot = m_frames.front();
+    m_target.presentFrame(slot.frame, slot.palette);
+    return true;
+}
+
+void AsyncVideoSink::close()
+{
+    m_running.store(false, std::memory_order_release);
+}
+
+uint64_t AsyncVideoSink::getFramesDropped() const
+{
+    return m_framesDropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,93 @@
+//
+//  asyncsink.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// LIB includes
+#include "videosink.hpp"
+#include "../util/triplebuffer.hpp"
+
+/*
+ Sink that hands frames from an emulation thread over to the thread that owns the window
+ 
+ Frames are copied into the back buffer of a triple buffer and published with a single atomic exchange, so the
+ emulation thread never waits on the window (texture uploads, vsync). The window thread always presents the newest
+ complete frame, and skips the ones that were published while it was busy.
+ 
+ Windows must be created and have their events handled on the main thread (macOS enforces it), so the window stays
+ there: the main thread runs the window loop and calls presentLatest(), and the emulation runs on a worker.
+ */
+class AsyncVideoSink : public VideoSink
+{
+    /*
+     Everything needed to present one frame
+     */
+    struct Slot
+    {
+        FrameBuffer frame;
+        Palette palette;
+    };
+    
+    VideoSink& m_target;
+    
+    TripleBuffer<Slot> m_frames;
+    uint64_t m_lastFrameNumber;         // Last frame published (emulation thread only)
+    
+    std::atomic<uint64_t> m_framesDropped;
+    std::atomic<bool> m_running;        // False once the window thread closed the sink
+    
+    // Wakes the window thread up early when a frame is published
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+
+public:
+    
+    /**
+     *  @param target Sink frames are presented to, only ever used from the thread that calls presentLatest()
+     */
+    AsyncVideoSink(VideoSink& target);
+    
+    AsyncVideoSink(const AsyncVideoSink&) = delete;
+    AsyncVideoSink& operator=(const AsyncVideoSink&) = delete;
+    
+    /* ----- EMULATION THREAD ----- */
+    
+    /**
+     *  Publishes a frame to the window thread (never blocks). A frame number that was already published is
+     *  ignored, so calling this on skipped frames costs nothing.
+     */
+    void presentFrame(const FrameBuffer& frame, const Palette& palette) override;
+    
+    // False once the window thread closed the sink, for the emulation loop to stop
+    bool running() const override;
+    
+    /* ----- WINDOW THREAD ----- */
+    
+    /**
+     *  Waits until a frame is published or the timeout runs out, so the window loop can keep handling events
+     *
+     *  @return True if a new frame is waiting
+     */
+    bool waitForFrame(std::chrono::milliseconds timeout);
+    
+    /**
+     *  Presents the newest published frame to the target sink, if there is one it hasn't seen
+     *
+     *  @return True if a frame was presented
+     */
+    bool presentLatest();
+    
+    // Stops the sink: running() turns false for the emulation thread
+    void close();
+    
+    // Frames that were replaced by a newer one before the window thread got to them
+    uint64_t getFramesDropped() const;
+};
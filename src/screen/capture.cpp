@@ -0,0 +1,243 @@
+//
+//  capture.cpp
+//  emulator_6502
+//
+
+#include "capture.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr int WIDTH = FrameBuffer::WIDTH;
+static constexpr int HEIGHT = FrameBuffer::HEIGHT;
+
+VideoCapture::VideoCapture()
+    : m_file(nullptr), m_format(CaptureFormat::Y4M), m_policy(CapturePolicy::BLOCK),
+      m_framesWritten(0), m_framesDropped(0), m_writeFailed(false)
+{
+    m_colorsLUT = {};
+}
+
+VideoCapture::~VideoCapture()
+{
+    stop();
+}
+
+bool VideoCapture::start(const char* filename, CaptureFormat format, CapturePolicy policy,
+                         uint32_t frameRateNum, uint32_t frameRateDen)
+{
+    stop();
+    
+    m_file = fopen(filename, "wb");
+    if (!m_file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+    
+    m_format = format;
+    m_policy = policy;
+    m_framesWritten = 0;
+    m_framesDropped = 0;
+    m_writeFailed = false;
+    
+    // NES pixels are 8:7 on an NTSC TV
+    if (format == CaptureFormat::Y4M)
+    {
+        fprintf(m_file, "YUV4MPEG2 W%d H%d F%u:%u Ip A8:7 C420jpeg\n", WIDTH, HEIGHT, frameRateNum, frameRateDen);
+    }
+    
+    m_buffers.assign(POOL_SIZE, std::vector<uint8_t>(frameSize(format)));
+    
+    for (int i = 0; i < static_cast<int>(POOL_SIZE); ++i)
+    {
+        m_free.push(i);
+    }
+    
+    m_writer = std::thread(&VideoCapture::writeLoop, this);
+    return true;
+}
+
+void VideoCapture::stop()
+{
+    if (!m_file)
+        return;
+    
+    // The stop marker is queued after every filled buffer, so they all get written first
+    m_filled.push(STOP);
+    m_filled.notify();
+    m_writer.join();
+    
+    fclose(m_file);
+    m_file = nullptr;
+    
+    int index;
+    while (m_free.pop(index)) {}
+}
+
+bool VideoCapture::isRecording() const
+{
+    return m_file != nullptr;
+}
+
+/* ---------- EMULATION THREAD ---------- */
+
+void VideoCapture::presentFrame(const FrameBuffer& frame, const Palette& palette)
+{
+    if (!m_file)
+        return;
+    
+    if (palette.getEmphasisLUT() != m_colorsLUT)
+    {
+        buildColors(palette);
+    }
+    
+    int index;
+    while (!m_free.pop(index))
+    {
+        if (m_policy == CapturePolicy::DROP)
+        {
+            m_framesDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        
+        m_free.waitForData();
+    }
+    
+    convert(frame, m_buffers[index].data());
+    
+    m_filled.push(index);
+    m_filled.notify();
+}
+
+uint64_t VideoCapture::getFramesWritten() const
+{
+    return m_framesWritten.load(std::memory_order_relaxed);
+}
+
+uint64_t VideoCapture::getFramesDropped() const
+{
+    return m_framesDropped.load(std::memory_order_relaxed);
+}
+
+bool VideoCapture::writeFailed() const
+{
+    return m_writeFailed.load(std::memory_order_relaxed);
+}
+
+size_t VideoCapture::frameSize(CaptureFormat format)
+{
+    if (format == CaptureFormat::Y4M)
+    {
+        // "FRAME\n", then full resolution Y and quarter resolution U and V
+        return 6 + (WIDTH * HEIGHT) + 2 * ((WIDTH / 2) * (HEIGHT / 2));
+    }
+    
+    return WIDTH * HEIGHT * 3;
+}
+
+/* ---------- PRIVATE FUNCTIONS ---------- */
+
+void VideoCapture::buildColors(const Palette& palette)
+{
+    m_colorsLUT = palette.getEmphasisLUT();
+    
+    for (int color = 0; color < 512; ++color)
+    {
+        const RGBField& rgb = m_colorsLUT[color];
+        CaptureColor& out = m_colors[color];
+        
+        // BT.601 full range (JPEG)
+        const float y = (0.299f * rgb.r) + (0.587f * rgb.g) + (0.114f * rgb.b);
+        const float u = 128.0f - (0.168736f * rgb.r) - (0.331264f * rgb.g) + (0.5f * rgb.b);
+        const float v = 128.0f + (0.5f * rgb.r) - (0.418688f * rgb.g) - (0.081312f * rgb.b);
+        
+        out.y = static_cast<uint8_t>(std::clamp(std::lround(y), 0L, 255L));
+        out.u = static_cast<uint8_t>(std::clamp(std::lround(u), 0L, 255L));
+        out.v = static_cast<uint8_t>(std::clamp(std::lround(v), 0L, 255L));
+        out.r = rgb.r;
+        out.g = rgb.g;
+        out.b = rgb.b;
+    }
+}
+
+void VideoCapture::convert(const FrameBuffer& frame, uint8_t* out) const
+{
+    if (m_format == CaptureFormat::RAW_RGB)
+    {
+        for (const uint16_t pixel : frame.pixels)
+        {
+            const CaptureColor& color = m_colors[pixel & 0x1FF];
+            *out++ = color.r;
+            *out++ = color.g;
+            *out++ = color.b;
+        }
+        
+        return;
+    }
+    
+    static constexpr char FRAME_HEADER[] = "FRAME\n";
+    out = std::copy(FRAME_HEADER, FRAME_HEADER + 6, out);
+    
+    uint8_t* lumaPlane = out;
+    uint8_t* uPlane = lumaPlane + (WIDTH * HEIGHT);
+    uint8_t* vPlane = uPlane + ((WIDTH / 2) * (HEIGHT / 2));
+    
+    // Each chroma sample averages a 2x2 block of pixels
+    for (int y = 0; y < HEIGHT; y += 2)
+    {
+        const uint16_t* top = frame.scanline(y);
+        const uint16_t* bottom = frame.scanline(y + 1);
+        uint8_t* lumaTop = lumaPlane + (y * WIDTH);
+        uint8_t* lumaBottom = lumaTop + WIDTH;
+        
+        for (int x = 0; x < WIDTH; x += 2)
+        {
+            const CaptureColor& a = m_colors[top[x] & 0x1FF];
+            const CaptureColor& b = m_colors[top[x + 1] & 0x1FF];
+            const CaptureColor& c = m_colors[bottom[x] & 0x1FF];
+            const CaptureColor& d = m_colors[bottom[x + 1] & 0x1FF];
+            
+            lumaTop[x] = a.y;
+            lumaTop[x + 1] = b.y;
+            lumaBottom[x] = c.y;
+            lumaBottom[x + 1] = d.y;
+            
+            *uPlane++ = static_cast<uint8_t>((a.u + b.u + c.u + d.u + 2) >> 2);
+            *vPlane++ = static_cast<uint8_t>((a.v + b.v + c.v + d.v + 2) >> 2);
+        }
+    }
+}
+
+/* ---------- WRITER THREAD ---------- */
+
+void VideoCapture::writeLoop()
+{
+    const size_t size = frameSize(m_format);
+    int index;
+    
+    while (true)
+    {
+        if (!m_filled.pop(index))
+        {
+            m_filled.waitForData();
+            continue;
+        }
+        
+        if (index == STOP)
+            break;
+        
+        if (!m_writeFailed.load(std::memory_order_relaxed))
+        {
+            if (fwrite(m_buffers[index].data(), 1, size, m_file) == size)
+                m_framesWritten.fetch_add(1, std::memory_order_relaxed);
+            else
+                m_writeFailed.store(true, std::memory_order_relaxed);
+        }
+        
+        m_free.push(index);
+        m_free.notify();
+    }
+    
+    fflush(m_file);
+}
@@ -0,0 +1,120 @@
+//
+//  capture.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// LIB includes
+#include "videosink.hpp"
+#include "../util/ringbuffer.hpp"
+
+enum class CaptureFormat
+{
+    Y4M,        // YUV4MPEG2, 4:2:0 full range (C420jpeg), playable and encodable as is
+    RAW_RGB     // Headerless 24 bit RGB frames (e.g. ffmpeg -f rawvideo -pix_fmt rgb24 -s 256x240)
+};
+
+enum class CapturePolicy
+{
+    BLOCK,      // Wait for the writer when every buffer is in use (no frame is ever lost)
+    DROP        // Drop the frame when every buffer is in use (emulation never waits on the disk)
+};
+
+/*
+ Sink that records every presented frame to a video file
+ 
+ Frames are converted through a per color lookup table on the emulation thread, into one of a fixed pool of
+ buffers, and written to disk by a background thread. Buffers are handed back and forth through two lock-free
+ queues, so nothing is allocated per frame and the emulation thread only ever waits in BLOCK mode, when the
+ disk can't keep up.
+ */
+class VideoCapture : public VideoSink
+{
+    static constexpr size_t POOL_SIZE = 8;
+    static constexpr int STOP = -1; // Pushed to the writer in place of a buffer index to end the thread
+    
+    /*
+     Output of one color in the capture format
+     */
+    struct CaptureColor
+    {
+        uint8_t y, u, v;    // Y4M
+        uint8_t r, g, b;    // RAW_RGB
+    };
+    
+    FILE* m_file;
+    CaptureFormat m_format;
+    CapturePolicy m_policy;
+    
+    std::vector<std::vector<uint8_t>> m_buffers;
+    RingBuffer<int, 16> m_free;     // Buffers the emulation thread can fill
+    RingBuffer<int, 16> m_filled;   // Buffers waiting to be written
+    std::thread m_writer;
+    
+    // Lookup table of the palette the last frame was presented with
+    std::array<CaptureColor, 512> m_colors;
+    std::array<RGBField, 512> m_colorsLUT;
+    
+    std::atomic<uint64_t> m_framesWritten;
+    std::atomic<uint64_t> m_framesDropped;
+    std::atomic<bool> m_writeFailed;
+
+public:
+    
+    VideoCapture();
+    ~VideoCapture() override;
+    
+    VideoCapture(const VideoCapture&) = delete;
+    VideoCapture& operator=(const VideoCapture&) = delete;
+    
+    /**
+     *  Starts recording into a new file (stopping any recording in progress)
+     *
+     *  @param filename File to write
+     *  @param format Y4M or raw RGB
+     *  @param policy What to do with a frame when the writer is behind
+     *  @param frameRateNum Frame rate written to the Y4M header, as a fraction (NTSC's ~60.0988 fps by default)
+     *  @param frameRateDen Denominator of the frame rate
+     *  @return False if the file couldn't be opened
+     */
+    bool start(const char* filename, CaptureFormat format, CapturePolicy policy = CapturePolicy::BLOCK,
+               uint32_t frameRateNum = 39375000, uint32_t frameRateDen = 655171);
+    
+    // Writes every pending frame and closes the file
+    void stop();
+    
+    bool isRecording() const;
+    
+    /**
+     *  Converts a frame and queues it for the writer (does nothing if not recording)
+     */
+    void presentFrame(const FrameBuffer& frame, const Palette& palette) override;
+    
+    uint64_t getFramesWritten() const;
+    uint64_t getFramesDropped() const;
+    
+    // Whether a write failed (e.g. disk full). Frames keep being accepted, but are lost
+    bool writeFailed() const;
+    
+    // Size of one frame in a format, in bytes
+    static size_t frameSize(CaptureFormat format);
+
+private:
+    
+    // Rebuilds m_colors from a palette
+    void buildColors(const Palette& palette);
+    
+    // Converts a frame into a buffer of frameSize() bytes
+    void convert(const FrameBuffer& frame, uint8_t* out) const;
+    
+    // Body of the writer thread
+    void writeLoop();
+};
@@ -8,10 +8,13 @@
 #include "gui.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
 
-GUI::GUI() : m_window(sf::VideoMode({256,240}), "NES Emulator"), m_screen(m_renderedNametable)
+GUI::GUI() : m_window(sf::VideoMode({256,240}), "NES Emulator"), m_screen(m_renderedNametable), m_presentedFrame(0),
+    m_focused(true)
 {
     if (!m_renderedNametable.resize({256,240}))
     {
@@ -29,14 +32,22 @@ GUI::GUI() : m_window(sf::VideoMode({256,240}), "NES Emulator"), m_screen(m_rend
         m_pixelRepr[i] = Pixel{0, 0, 0};
     }
     
+    m_presentedLUT = {};
+    
+    markRowsDirty(0, 240);
     updateNametable();
 }
 
-const bool GUI::running() const
+bool GUI::running() const
 {
     return m_window.isOpen();
 }
 
+bool GUI::hasFocus() const
+{
+    return m_focused.load(std::memory_order_relaxed);
+}
+
 void GUI::update()
 {
     while (const std::optional event = m_window.pollEvent())
@@ -45,6 +56,10 @@ void GUI::update()
            (event->is<sf::Event::KeyPressed>() &&
             event->getIf<sf::Event::KeyPressed>()->code == sf::Keyboard::Key::Escape))
             m_window.close();
+        else if (event->is<sf::Event::FocusLost>())
+            m_focused = false;
+        else if (event->is<sf::Event::FocusGained>())
+            m_focused = true;
     }
 }
 
@@ -67,9 +82,93 @@ void GUI::updateNametable()
 {
     // This works as m_pixelRepr stores a simple struct (Pixel) that can easily be
     // written into the r,g,b,a uint8_t format that SFML wants
-    m_renderedNametable.update(reinterpret_cast<const uint8_t*>(m_pixelRepr.data()),
-                              {256,240}, // Size of screen (256*240)
-                              {0,0});    // Position of screen
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(m_pixelRepr.data());
+    
+    // Each run of consecutive dirty rows is uploaded as one sub-rectangle of the texture
+    int row = 0;
+    while (row < 240)
+    {
+        if (!m_dirtyRows[row])
+        {
+            row++;
+            continue;
+        }
+        
+        int end = row + 1;
+        while (end < 240 && m_dirtyRows[end])
+        {
+            end++;
+        }
+        
+        m_renderedNametable.update(pixels + (row * 256 * sizeof(Pixel)),
+                                   {256, static_cast<unsigned>(end - row)}, // Size of the run of rows
+                                   {0, static_cast<unsigned>(row)});       // Position of the run
+        row = end;
+    }
+    
+    m_dirtyRows.reset();
+}
+
+void GUI::presentFrame(const FrameBuffer& frame, const Palette& palette)
+{
+    uint8_t* pixels = reinterpret_cast<uint8_t*>(m_pixelRepr.data());
+    
+    // A new palette, or a frame from before the last one (e.g. after a reset), changes every line
+    if (palette.getEmphasisLUT() != m_presentedLUT || frame.frameNumber < m_presentedFrame)
+    {
+        // Pixel is laid out as r,g,b,a which matches the output of toRGBA
+        frame.toRGBA(palette, pixels);
+        markRowsDirty(0, 240);
+        
+        m_presentedLUT = palette.getEmphasisLUT();
+    }
+    else if (frame.lastChangedAt > m_presentedFrame)
+    {
+        for (int y = 0; y < 240; ++y)
+        {
+            if (frame.lineChangedAt[y] > m_presentedFrame)
+            {
+                frame.lineToRGBA(y, palette, pixels + (y * 256 * sizeof(Pixel)));
+                m_dirtyRows.set(y);
+            }
+        }
+    }
+    
+    m_presentedFrame = frame.frameNumber;
+}
+
+void GUI::writeScanline(int y, const uint32_t* rgba)
+{
+    if (y < 0 || y >= 240)
+    {
+        std::cerr << "Tried writing a scanline that is out of bounds.\n";
+        return;
+    }
+    
+    std::memcpy(reinterpret_cast<uint8_t*>(&m_pixelRepr[256 * y]), rgba, 256 * sizeof(Pixel));
+    m_dirtyRows.set(y);
+}
+
+void GUI::writeRect(int x, int y, int width, int height, const uint32_t* rgba, int pitch)
+{
+    // Clip to the screen, moving the start of the source along with the rectangle
+    const int left = std::max(x, 0);
+    const int top = std::max(y, 0);
+    const int right = std::min(x + width, 256);
+    const int bottom = std::min(y + height, 240);
+    
+    if (left >= right || top >= bottom)
+        return;
+    
+    const uint32_t* src = rgba + (static_cast<ptrdiff_t>(top - y) * pitch) + (left - x);
+    const size_t rowBytes = static_cast<size_t>(right - left) * sizeof(Pixel);
+    
+    for (int row = top; row < bottom; ++row, src += pitch)
+    {
+        std::memcpy(reinterpret_cast<uint8_t*>(&m_pixelRepr[(256 * row) + left]), src, rowBytes);
+    }
+    
+    markRowsDirty(top, bottom);
 }
 
 /*
@@ -83,9 +182,11 @@ void GUI::drawPixel(int x, int y, struct Pixel color)
     if (!inBounds(x, y))
     {
         std::cerr << "Tried accessing memory that is out of bounds.\n";
+        return;
     }
     
     m_pixelRepr[(256 * y) + x] = color;
+    m_dirtyRows.set(y);
 }
 
 Pixel GUI::getPixel(int x, int y) const
@@ -93,6 +194,7 @@ Pixel GUI::getPixel(int x, int y) const
     if (!inBounds(x, y))
     {
         std::cerr << "Tried accessing memory that is out of bounds.\n";
+        return Pixel{0, 0, 0};
     }
     
     return m_pixelRepr[(256 * y) + x];
@@ -102,3 +204,11 @@ const bool GUI::inBounds(int x, int y) const
 {
     return ((x >= 0) && (x < 256)) && ((y >= 0) && (y < 240));
 }
+
+void GUI::markRowsDirty(int first, int end)
+{
+    for (int row = first; row < end; ++row)
+    {
+        m_dirtyRows.set(row);
+    }
+}
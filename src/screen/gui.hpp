@@ -10,6 +10,11 @@
 // STD Library includes
 #include <stdio.h>
 #include <array>
+#include <atomic>
+#include <bitset>
+
+// LIB includes
+#include "videosink.hpp"
 
 // SFML includes
 #include <SFML/Graphics.hpp>
@@ -25,7 +30,12 @@ struct Pixel
     uint8_t a = 0xFF;
 };
 
-class GUI {
+static_assert(sizeof(Pixel) == 4, "Pixel must match the packed RGBA layout of the span writes");
+
+/*
+ SFML window the frames are presented to
+ */
+class GUI : public VideoSink {
     // Important variables for screen
     sf::RenderWindow m_window;
     
@@ -33,24 +43,73 @@ class GUI {
     sf::Texture m_renderedNametable;  // Off-screen buffer that is later drawn onto sf::Sprite
     sf::Sprite m_screen;
     
+    // Rows of m_pixelRepr that changed since they were last uploaded to the texture
+    std::bitset<240> m_dirtyRows;
+    
+    // Frame number and palette m_pixelRepr was last expanded from, to only expand the lines that changed since
+    uint64_t m_presentedFrame;
+    std::array<RGBField, 512> m_presentedLUT;
+    
+    // Whether the window has keyboard focus, read by the input thread
+    std::atomic<bool> m_focused;
+
 public:
     // Constructors & Destructors
     GUI();
     
     // Checks if the game is running or not
-    const bool running() const;
+    bool running() const override;
+    
+    // Whether the window has keyboard focus (safe to call from any thread)
+    bool hasFocus() const;
     
     // Game loop functions
-    void update();
-    void render();
+    void update() override;
+    void render() override;
     
-    // Updates the m_renderedNametable function with the new data from m_pixelRepr
+    // Uploads the rows of m_pixelRepr that changed to m_renderedNametable (nothing if no row changed)
     void updateNametable();
     
-    // Draws and gets pixels from m_pixelRepr
+    /**
+     *  Expands an indexed frame from the PPU into m_pixelRepr. This is the only point where
+     *  the PPU output is converted to RGBA. Only the lines stamped as changed after the last presented frame
+     *  are expanded, unless the palette changed.
+     *
+     *  @param frame Indexed frame outputted by the PPU
+     *  @param palette Palette used to resolve the color and emphasis bits of each pixel
+     */
+    void presentFrame(const FrameBuffer& frame, const Palette& palette) override;
+    
+    /**
+     *  Copies a full row of pixels into m_pixelRepr
+     *
+     *  @param y Row to write (0-239)
+     *  @param rgba 256 pixels of 4 bytes in r, g, b, a order (the layout of Pixel, and of FrameBuffer::toRGBA)
+     */
+    void writeScanline(int y, const uint32_t* rgba);
+    
+    /**
+     *  Copies a rectangle of pixels into m_pixelRepr, clipped to the screen. Bounds are checked once per call,
+     *  then each row is a single copy.
+     *
+     *  @param x Left side of the rectangle on the screen (may be negative)
+     *  @param y Top of the rectangle on the screen (may be negative)
+     *  @param width Width of the rectangle in pixels
+     *  @param height Height of the rectangle in pixels
+     *  @param rgba Pixels of the rectangle, in the same layout as writeScanline()
+     *  @param pitch Distance between two rows of rgba, in pixels
+     */
+    void writeRect(int x, int y, int width, int height, const uint32_t* rgba, int pitch);
+    
+    // Draws and gets single pixels from m_pixelRepr (prefer writeScanline/writeRect for anything bigger)
     void drawPixel(int x, int y, struct Pixel color);
     Pixel getPixel(int x, int y) const;
     
     // Other helper functions
     const bool inBounds(int x, int y) const;
+
+private:
+    
+    // Marks rows [first, end) as needing an upload
+    void markRowsDirty(int first, int end);
 };
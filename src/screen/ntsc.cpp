@@ -0,0 +1,162 @@
+//
+//  ntsc.cpp
+//  emulator_6502
+//
+
+#include "ntsc.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NTSC_USE_SSE2 1
+#endif
+
+// Color used outside of the picture (pixel -1 and the padding after pixel 255)
+static constexpr uint16_t BORDER_COLOR = 0x0F;
+
+NTSCFilter::NTSCFilter(BandWorkers* workers, float hue) : m_workers(workers)
+{
+    buildKernels(hue);
+}
+
+void NTSCFilter::filter(const FrameBuffer& frame, uint8_t* out, int burstPhase) const
+{
+    if (!m_workers)
+    {
+        filterRows(frame, out, burstPhase, 0, OUT_HEIGHT);
+        return;
+    }
+    
+    m_workers->run(OUT_HEIGHT, [&](int firstRow, int endRow)
+    {
+        filterRows(frame, out, burstPhase, firstRow, endRow);
+    });
+}
+
+void NTSCFilter::filterRows(const FrameBuffer& frame, uint8_t* out, int burstPhase, int firstRow, int endRow) const
+{
+    constexpr int GROUPS = OUT_WIDTH / GROUP_OUTPUTS;
+    
+    // Input line with a border pixel before it and enough after it for the taps of the last group
+    std::array<uint16_t, 1 + (GROUPS * GROUP_PIXELS) + TAPS> line;
+    line.fill(BORDER_COLOR);
+    
+    for (int y = firstRow; y < endRow; ++y)
+    {
+        // Every scanline is 341 * 8 samples long, which moves the subcarrier by 4 samples (a third of a period)
+        const int phase = (burstPhase + y) % PHASES;
+        
+        const uint16_t* src = frame.scanline(y);
+        for (int x = 0; x < FrameBuffer::WIDTH; ++x)
+        {
+            line[1 + x] = src[x] & (COLORS - 1);
+        }
+        
+        uint8_t* dst = out + (static_cast<size_t>(y) * OUT_WIDTH * 4);
+        
+        for (int group = 0; group < GROUPS; ++group)
+        {
+            const uint16_t* pixels = line.data() + 1 + (group * GROUP_PIXELS);
+            
+            for (int output = 0; output < GROUP_OUTPUTS; ++output)
+            {
+                const uint16_t* taps = pixels + m_firstTap[output];
+                const KernelEntry& a = kernel(phase, output, 0)[taps[0]];
+                const KernelEntry& b = kernel(phase, output, 1)[taps[1]];
+                const KernelEntry& c = kernel(phase, output, 2)[taps[2]];
+
+#ifdef NTSC_USE_SSE2
+                // The 3 contributions are added as 4 lanes of 16 bits, then shifted and saturated to bytes at once
+                __m128i sum = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a.data()));
+                sum = _mm_adds_epi16(sum, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b.data())));
+                sum = _mm_adds_epi16(sum, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.data())));
+                sum = _mm_srai_epi16(sum, KERNEL_SHIFT);
+                sum = _mm_packus_epi16(sum, sum);
+                sum = _mm_or_si128(sum, _mm_cvtsi32_si128(static_cast<int>(0xFF000000)));
+                
+                const int rgba = _mm_cvtsi128_si32(sum);
+                std::memcpy(dst, &rgba, 4);
+#else
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    int value = (a[channel] + b[channel] + c[channel]) >> KERNEL_SHIFT;
+                    dst[channel] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+                }
+                dst[3] = 0xFF;
+#endif
+                dst += 4;
+            }
+        }
+    }
+}
+
+/* ---------- PRIVATE FUNCTIONS ---------- */
+
+const NTSCFilter::KernelEntry* NTSCFilter::kernel(int phase, int output, int tap) const
+{
+    return m_kernels.data() + ((((phase * GROUP_OUTPUTS) + output) * TAPS) + tap) * COLORS;
+}
+
+void NTSCFilter::buildKernels(float hue)
+{
+    constexpr int SAMPLES_PER_PIXEL = 8;
+    constexpr int WINDOW = 12;          // One subcarrier period
+    constexpr float SCALE = 255.0f * (1 << KERNEL_SHIFT);
+    
+    m_kernels.assign(PHASES * GROUP_OUTPUTS * TAPS * COLORS, KernelEntry {});
+    
+    const float hueOffset = Palette::BURST_OFFSET + (hue * WINDOW / 360.0f);
+    
+    for (int output = 0; output < GROUP_OUTPUTS; ++output)
+    {
+        // Center of the output pixel, in samples from the start of the group
+        const float center = (output + 0.5f) * (GROUP_PIXELS * SAMPLES_PER_PIXEL) / GROUP_OUTPUTS;
+        const int firstSample = static_cast<int>(std::ceil(center - (WINDOW / 2)));
+        
+        m_firstTap[output] = static_cast<int>(std::floor(static_cast<float>(firstSample) / SAMPLES_PER_PIXEL));
+        
+        for (int phase = 0; phase < PHASES; ++phase)
+        {
+            for (uint16_t color = 0; color < COLORS; ++color)
+            {
+                for (int tap = 0; tap < TAPS; ++tap)
+                {
+                    float y = 0, i = 0, q = 0;
+                    
+                    for (int sample = firstSample; sample < firstSample + WINDOW; ++sample)
+                    {
+                        // Only the samples of the window that belong to this tap's pixel
+                        if (static_cast<int>(std::floor(static_cast<float>(sample) / SAMPLES_PER_PIXEL)) != m_firstTap[output] + tap)
+                            continue;
+                        
+                        const int samplePhase = (((phase * 4) + sample) % WINDOW + WINDOW) % WINDOW;
+                        const float level = Palette::compositeLevel(color, samplePhase) / WINDOW;
+                        const float angle = static_cast<float>(M_PI) * (samplePhase + hueOffset) / 6.0f;
+                        
+                        // Synchronous demodulation: mixing with the subcarrier halves the chroma amplitude
+                        y += level;
+                        i += 2.0f * level * std::cos(angle);
+                        q += 2.0f * level * std::sin(angle);
+                    }
+                    
+                    // YIQ to RGB (FCC matrix)
+                    const float rgb[3] = {
+                        y + (0.946882f * i) + (0.623557f * q),
+                        y - (0.274788f * i) - (0.635691f * q),
+                        y - (1.108545f * i) + (1.709007f * q)
+                    };
+                    
+                    KernelEntry& entry = m_kernels[(((((phase * GROUP_OUTPUTS) + output) * TAPS) + tap) * COLORS) + color];
+                    
+                    for (int channel = 0; channel < 3; ++channel)
+                    {
+                        entry[channel] = static_cast<int16_t>(std::lround(rgb[channel] * SCALE));
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,90 @@
+//
+//  ntsc.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+// LIB includes
+#include "../PPU/framebuffer.hpp"
+#include "../util/bandworkers.hpp"
+
+/*
+ NTSC composite video filter
+ 
+ Simulates the signal the PPU puts on the composite output and decodes it back like a TV would, which
+ produces the color fringing, dot crawl and blending that games were drawn for.
+ 
+ Signal: each pixel lasts 8 samples of a square wave at the 3.58 MHz color subcarrier (12 samples per period).
+ Its two levels come from the luma bits of the color, and its phase from the hue bits. Emphasis attenuates the
+ wave during a third of each period.
+ 
+ Decoding: each output pixel demodulates Y, I and Q over a 12 sample window of the signal. 3 input pixels
+ (24 samples) give 7 output pixels, so 256 pixels are widened to OUT_WIDTH.
+ 
+ The decoder is linear, so what each input pixel adds to an output pixel only depends on its 9 bit color, its
+ position in the group of 3, and the subcarrier phase of the line. Those contributions are precomputed as RGB,
+ which leaves the same 3 table lookups and adds for every output pixel.
+ */
+class NTSCFilter
+{
+public:
+    
+    static constexpr int OUT_WIDTH = 602;  // 86 groups of 7 output pixels (the last group is padded with black)
+    static constexpr int OUT_HEIGHT = FrameBuffer::HEIGHT;
+
+private:
+    
+    static constexpr int GROUP_PIXELS = 3;      // Input pixels per group
+    static constexpr int GROUP_OUTPUTS = 7;     // Output pixels per group
+    static constexpr int TAPS = 3;              // Input pixels that contribute to each output pixel
+    static constexpr int PHASES = 3;            // The subcarrier phase of a line is one of 0, 4 or 8 samples
+    static constexpr int COLORS = 512;
+    
+    // Fixed point scale of the precomputed contributions (r, g, b, unused)
+    static constexpr int KERNEL_SHIFT = 5;
+    
+    using KernelEntry = std::array<int16_t, 4>;
+    
+    // [phase][output in group][tap][color]
+    std::vector<KernelEntry> m_kernels;
+    
+    // First input pixel (relative to the first pixel of the group) read by each output pixel of a group
+    std::array<int, GROUP_OUTPUTS> m_firstTap;
+    
+    BandWorkers* m_workers;
+
+public:
+    
+    /**
+     *  Precomputes the decoder kernels
+     *
+     *  @param workers Pool the rows of each frame are split across (nullptr filters on the calling thread only)
+     *  @param hue Hue adjustment in degrees
+     */
+    NTSCFilter(BandWorkers* workers = nullptr, float hue = 0.0f);
+    
+    /**
+     *  Filters an indexed frame into RGBA (4 bytes per pixel, alpha always 0xFF)
+     *
+     *  @param frame Indexed frame outputted by the PPU
+     *  @param out Destination buffer. Must hold at least OUT_WIDTH * OUT_HEIGHT * 4 bytes
+     *  @param burstPhase Subcarrier phase of the frame (0-2). The PPU alternates between two phases every frame
+     *                    (frameNumber & 1 is a good choice), which is what makes the artifacts crawl
+     */
+    void filter(const FrameBuffer& frame, uint8_t* out, int burstPhase) const;
+    
+    // Same as filter(), but only for rows [firstRow, endRow) (out still points at the top of the frame)
+    void filterRows(const FrameBuffer& frame, uint8_t* out, int burstPhase, int firstRow, int endRow) const;
+
+private:
+    
+    const KernelEntry* kernel(int phase, int output, int tap) const;
+    
+    // Fills the kernel table for a hue adjustment
+    void buildKernels(float hue);
+};
@@ -0,0 +1,234 @@
+//
+//  screenshot.cpp
+//  emulator_6502
+//
+
+#include "screenshot.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+
+static constexpr int WIDTH = FrameBuffer::WIDTH;
+static constexpr int HEIGHT = FrameBuffer::HEIGHT;
+
+// PNG color types
+static constexpr uint8_t COLOR_RGB = 2;
+static constexpr uint8_t COLOR_INDEXED = 3;
+
+static void appendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Appends a chunk: length, type, data, and the CRC of type and data
+static void appendChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+    appendBigEndian(out, static_cast<uint32_t>(size));
+    
+    const size_t typeStart = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    
+    appendBigEndian(out, Deflater::crc32(out.data() + typeStart, size + 4));
+}
+
+ScreenshotWriter::ScreenshotWriter() : m_jobs(POOL_SIZE), m_written(0), m_dropped(0), m_failed(0)
+{
+    for (int i = 0; i < static_cast<int>(POOL_SIZE); ++i)
+    {
+        m_free.push(i);
+    }
+    
+    m_worker = std::thread(&ScreenshotWriter::encodeLoop, this);
+}
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+    // The stop marker is queued after every pending job, so they all get written first
+    m_filled.push(STOP);
+    m_filled.notify();
+    m_worker.join();
+}
+
+/* ---------- EMULATION THREAD ---------- */
+
+bool ScreenshotWriter::capture(const FrameBuffer& frame, const Palette& palette, const std::string& filename)
+{
+    int index;
+    if (!m_free.pop(index))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    Job& job = m_jobs[index];
+    job.pixels = frame.pixels;
+    job.colors = palette.getEmphasisLUT();
+    job.filename = filename;
+    
+    m_filled.push(index);
+    m_filled.notify();
+    return true;
+}
+
+void ScreenshotWriter::flush()
+{
+    // Every job is back in the free queue once the worker is idle
+    std::array<int, POOL_SIZE> returned;
+    
+    for (size_t collected = 0; collected < POOL_SIZE;)
+    {
+        if (m_free.pop(returned[collected]))
+            ++collected;
+        else
+            m_free.waitForData();
+    }
+    
+    for (int index : returned)
+    {
+        m_free.push(index);
+    }
+}
+
+uint64_t ScreenshotWriter::getWritten() const
+{
+    return m_written.load(std::memory_order_relaxed);
+}
+
+uint64_t ScreenshotWriter::getDropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t ScreenshotWriter::getFailed() const
+{
+    return m_failed.load(std::memory_order_relaxed);
+}
+
+/* ---------- ENCODER ---------- */
+
+void ScreenshotWriter::encodePNG(const uint16_t* pixels, const std::array<RGBField, 512>& colors, Deflater& deflater,
+                                 std::vector<uint8_t>& scratch, std::vector<uint8_t>& compressed,
+                                 std::vector<uint8_t>& out)
+{
+    // Palette entry of each of the 512 colors, in order of first use
+    std::array<int16_t, 512> entries;
+    entries.fill(-1);
+    
+    std::vector<uint8_t> palette;
+    bool indexed = true;
+    
+    for (int i = 0; i < WIDTH * HEIGHT && indexed; ++i)
+    {
+        const uint16_t color = pixels[i] & 0x1FF;
+        if (entries[color] >= 0)
+            continue;
+        
+        if (palette.size() == 256 * 3)
+        {
+            indexed = false;
+            break;
+        }
+        
+        entries[color] = static_cast<int16_t>(palette.size() / 3);
+        palette.push_back(colors[color].r);
+        palette.push_back(colors[color].g);
+        palette.push_back(colors[color].b);
+    }
+    
+    // Rows with filter type 0 (none), which suits paletted images best
+    const int bytesPerPixel = indexed ? 1 : 3;
+    const size_t rowSize = 1 + (WIDTH * bytesPerPixel);
+    scratch.resize(rowSize * HEIGHT);
+    
+    uint8_t* row = scratch.data();
+    
+    for (int y = 0; y < HEIGHT; ++y, row += rowSize)
+    {
+        const uint16_t* line = pixels + (y * WIDTH);
+        uint8_t* dst = row;
+        *dst++ = 0;
+        
+        for (int x = 0; x < WIDTH; ++x)
+        {
+            const uint16_t color = line[x] & 0x1FF;
+            
+            if (indexed)
+            {
+                *dst++ = static_cast<uint8_t>(entries[color]);
+            }
+            else
+            {
+                *dst++ = colors[color].r;
+                *dst++ = colors[color].g;
+                *dst++ = colors[color].b;
+            }
+        }
+    }
+    
+    deflater.compressZlib(scratch.data(), scratch.size(), compressed);
+    
+    static constexpr uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    
+    out.clear();
+    out.insert(out.end(), SIGNATURE, SIGNATURE + 8);
+    
+    // Width, height, 8 bits per sample, color type, default compression, filtering, and no interlacing
+    uint8_t header[13] = {};
+    header[2] = WIDTH >> 8;
+    header[3] = WIDTH & 0xFF;
+    header[6] = HEIGHT >> 8;
+    header[7] = HEIGHT & 0xFF;
+    header[8] = 8;
+    header[9] = indexed ? COLOR_INDEXED : COLOR_RGB;
+    
+    appendChunk(out, "IHDR", header, sizeof(header));
+    
+    if (indexed)
+        appendChunk(out, "PLTE", palette.data(), palette.size());
+    
+    appendChunk(out, "IDAT", compressed.data(), compressed.size());
+    appendChunk(out, "IEND", nullptr, 0);
+}
+
+/* ---------- WORKER THREAD ---------- */
+
+void ScreenshotWriter::encodeLoop()
+{
+    int index;
+    
+    while (true)
+    {
+        if (!m_filled.pop(index))
+        {
+            m_filled.waitForData();
+            continue;
+        }
+        
+        if (index == STOP)
+            break;
+        
+        const Job& job = m_jobs[index];
+        encodePNG(job.pixels.data(), job.colors, m_deflater, m_rows, m_compressed, m_png);
+        
+        FILE* file = fopen(job.filename.c_str(), "wb");
+        const bool saved = file && fwrite(m_png.data(), 1, m_png.size(), file) == m_png.size();
+        
+        if (file && fclose(file) != 0)
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+        else if (saved)
+            m_written.fetch_add(1, std::memory_order_relaxed);
+        else
+        {
+            perror("Error writing screenshot");
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        m_free.push(index);
+        m_free.notify();
+    }
+}
@@ -0,0 +1,100 @@
+//
+//  screenshot.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// LIB includes
+#include "../PPU/framebuffer.hpp"
+#include "../util/deflate.hpp"
+#include "../util/ringbuffer.hpp"
+
+/*
+ Saves frames as PNG files on a background thread
+ 
+ The emulation thread only copies the indexed frame and its emphasis LUT into one of a fixed pool of jobs. The
+ worker maps the colors the frame uses to a PNG palette (frames rarely use more than a few dozen of the 512),
+ compresses the rows with the in-tree Deflater, and writes the file. Frames that somehow use more than 256 colors
+ are saved as 24 bit RGB instead. Jobs are handed back and forth through two lock-free queues, like VideoCapture.
+ */
+class ScreenshotWriter
+{
+    static constexpr size_t POOL_SIZE = 4;
+    static constexpr int STOP = -1; // Pushed to the worker in place of a job index to end the thread
+    
+    /*
+     Frame waiting to be encoded
+     */
+    struct Job
+    {
+        std::array<uint16_t, FrameBuffer::WIDTH * FrameBuffer::HEIGHT> pixels;
+        std::array<RGBField, 512> colors;
+        std::string filename;
+    };
+    
+    std::vector<Job> m_jobs;
+    RingBuffer<int, 8> m_free;      // Jobs the emulation thread can fill
+    RingBuffer<int, 8> m_filled;    // Jobs waiting to be encoded
+    std::thread m_worker;
+    
+    // Owned by the worker: reused between screenshots
+    Deflater m_deflater;
+    std::vector<uint8_t> m_rows;
+    std::vector<uint8_t> m_compressed;
+    std::vector<uint8_t> m_png;
+    
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_failed;
+
+public:
+    
+    ScreenshotWriter();
+    ~ScreenshotWriter();
+    
+    ScreenshotWriter(const ScreenshotWriter&) = delete;
+    ScreenshotWriter& operator=(const ScreenshotWriter&) = delete;
+    
+    /**
+     *  Queues a frame to be saved. Never waits: if every job is in use, the screenshot is dropped.
+     *
+     *  @param frame Frame to save (usually PPU::getFrame())
+     *  @param palette Palette the frame is presented with
+     *  @param filename PNG file to write
+     *  @return False if the screenshot was dropped
+     */
+    bool capture(const FrameBuffer& frame, const Palette& palette, const std::string& filename);
+    
+    // Waits until every queued screenshot is written
+    void flush();
+    
+    uint64_t getWritten() const;
+    uint64_t getDropped() const;
+    uint64_t getFailed() const;   // Files that couldn't be written
+    
+    /**
+     *  Encodes a frame as a PNG, on the calling thread
+     *
+     *  @param pixels Indexed pixels of the frame (FrameBuffer layout)
+     *  @param colors Emphasis LUT of the palette
+     *  @param deflater Compressor to use
+     *  @param scratch Buffer for the unfiltered rows (its capacity is reused)
+     *  @param compressed Buffer for the compressed rows (its capacity is reused)
+     *  @param out Replaced with the PNG file contents
+     */
+    static void encodePNG(const uint16_t* pixels, const std::array<RGBField, 512>& colors, Deflater& deflater,
+                          std::vector<uint8_t>& scratch, std::vector<uint8_t>& compressed, std::vector<uint8_t>& out);
+
+private:
+    
+    // Body of the worker thread
+    void encodeLoop();
+};
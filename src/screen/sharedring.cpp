@@ -0,0 +1,268 @@
+//
+//  sharedring.cpp
+//  emulator_6502
+//
+
+#include "sharedring.hpp"
+
+#include <stdio.h>
+#include <cstring>
+
+// LIB includes
+#include "../PPU/framehash.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SHARED_RING_POSIX 1
+#endif
+
+// Slots start on a cache line after the header
+static constexpr size_t SLOTS_OFFSET = (sizeof(SharedRingHeader) + 63) & ~static_cast<size_t>(63);
+
+static size_t ringSize(uint32_t slotCount)
+{
+    return SLOTS_OFFSET + (static_cast<size_t>(slotCount) * sizeof(SharedFrameSlot));
+}
+
+static const SharedFrameSlot* slotAt(const SharedRingHeader* header, uint32_t index)
+{
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(header) + SLOTS_OFFSET;
+    return reinterpret_cast<const SharedFrameSlot*>(base + (static_cast<size_t>(index) * header->slotSize));
+}
+
+/* ---------- WRITER ---------- */
+
+SharedFrameRing::SharedFrameRing() : m_header(nullptr), m_mappedSize(0), m_inputState(0) {}
+
+SharedFrameRing::~SharedFrameRing()
+{
+    close();
+}
+
+bool SharedFrameRing::create(const char* name, uint32_t slotCount)
+{
+    close();
+
+#ifdef SHARED_RING_POSIX
+    if (slotCount < 2)
+        slotCount = 2;
+    
+    // Start from a fresh object, so readers of a previous ring don't see a half initialized one
+    shm_unlink(name);
+    
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        perror("Error creating shared memory");
+        return false;
+    }
+    
+    const size_t size = ringSize(slotCount);
+    
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        perror("Error sizing shared memory");
+        ::close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    
+    if (mapping == MAP_FAILED)
+    {
+        perror("Error mapping shared memory");
+        shm_unlink(name);
+        return false;
+    }
+    
+    // The object is zero filled by ftruncate, so every sequence starts even and latestFrame at 0
+    m_header = static_cast<SharedRingHeader*>(mapping);
+    m_header->magic = SharedRingHeader::MAGIC;
+    m_header->version = SharedRingHeader::VERSION;
+    m_header->slotCount = slotCount;
+    m_header->slotSize = sizeof(SharedFrameSlot);
+    m_header->width = FrameBuffer::WIDTH;
+    m_header->height = FrameBuffer::HEIGHT;
+    m_header->latestSlot.store(slotCount - 1, std::memory_order_relaxed);
+    m_header->latestFrame.store(0, std::memory_order_release);
+    
+    m_name = name;
+    m_mappedSize = size;
+    return true;
+#else
+    fprintf(stderr, "Shared memory frame rings need POSIX shared memory\n");
+    return false;
+#endif
+}
+
+void SharedFrameRing::close()
+{
+#ifdef SHARED_RING_POSIX
+    if (!m_header)
+        return;
+    
+    munmap(m_header, m_mappedSize);
+    shm_unlink(m_name.c_str());
+    
+    m_header = nullptr;
+    m_mappedSize = 0;
+    m_name.clear();
+#endif
+}
+
+void SharedFrameRing::setInputState(uint32_t state)
+{
+    m_inputState = state;
+}
+
+void SharedFrameRing::presentFrame(const FrameBuffer& frame, const Palette& palette)
+{
+    if (!m_header)
+        return;
+    
+    const uint32_t index = (m_header->latestSlot.load(std::memory_order_relaxed) + 1) % m_header->slotCount;
+    SharedFrameSlot* target = slot(index);
+    
+    // Seqlock: odd while writing, and the data stores can't move above the odd store
+    const uint32_t sequence = target->sequence.load(std::memory_order_relaxed);
+    target->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    target->inputState = m_inputState;
+    target->frameNumber = frame.frameNumber;
+    target->hash = hashFrame(frame);
+    target->palette = palette.getEmphasisLUT();
+    std::memcpy(target->pixels.data(), frame.pixels.data(), sizeof(target->pixels));
+    
+    target->sequence.store(sequence + 2, std::memory_order_release);
+    
+    m_header->latestSlot.store(index, std::memory_order_relaxed);
+    m_header->latestFrame.store(frame.frameNumber, std::memory_order_release);
+}
+
+SharedFrameSlot* SharedFrameRing::slot(uint32_t index) const
+{
+    return const_cast<SharedFrameSlot*>(slotAt(m_header, index));
+}
+
+/* ---------- READER ---------- */
+
+SharedFrameReader::SharedFrameReader() : m_header(nullptr), m_mappedSize(0) {}
+
+SharedFrameReader::~SharedFrameReader()
+{
+    close();
+}
+
+bool SharedFrameReader::open(const char* name)
+{
+    close();
+
+#ifdef SHARED_RING_POSIX
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror("Error opening shared memory");
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < SLOTS_OFFSET)
+    {
+        ::close(fd);
+        return false;
+    }
+    
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    
+    if (mapping == MAP_FAILED)
+    {
+        perror("Error mapping shared memory");
+        return false;
+    }
+    
+    const SharedRingHeader* header = static_cast<const SharedRingHeader*>(mapping);
+    
+    if (header->magic != SharedRingHeader::MAGIC || header->version != SharedRingHeader::VERSION ||
+        header->slotSize != sizeof(SharedFrameSlot) || size < ringSize(header->slotCount))
+    {
+        fprintf(stderr, "%s is not a compatible frame ring\n", name);
+        munmap(mapping, size);
+        return false;
+    }
+    
+    m_header = header;
+    m_mappedSize = size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SharedFrameReader::close()
+{
+#ifdef SHARED_RING_POSIX
+    if (!m_header)
+        return;
+    
+    munmap(const_cast<SharedRingHeader*>(m_header), m_mappedSize);
+    m_header = nullptr;
+    m_mappedSize = 0;
+#endif
+}
+
+uint64_t SharedFrameReader::latestFrame() const
+{
+    return m_header ? m_header->latestFrame.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedFrameReader::readLatest(FrameBuffer& out, std::array<RGBField, 512>* palette, uint32_t* inputState) const
+{
+    uint32_t sequence;
+    
+    while (const SharedFrameSlot* slot = acquireLatest(sequence))
+    {
+        out.frameNumber = slot->frameNumber;
+        std::memcpy(out.pixels.data(), slot->pixels.data(), sizeof(slot->pixels));
+        
+        if (palette)
+            *palette = slot->palette;
+        
+        if (inputState)
+            *inputState = slot->inputState;
+        
+        if (stillValid(slot, sequence))
+            return true;
+    }
+    
+    return false;
+}
+
+const SharedFrameSlot* SharedFrameReader::acquireLatest(uint32_t& sequence) const
+{
+    if (!m_header || m_header->latestFrame.load(std::memory_order_acquire) == 0)
+        return nullptr;
+    
+    while (true)
+    {
+        const SharedFrameSlot* slot = slotAt(m_header, m_header->latestSlot.load(std::memory_order_acquire));
+        sequence = slot->sequence.load(std::memory_order_acquire);
+        
+        // Odd: the writer lapped the ring and is rewriting this slot, so a newer one will be latest shortly
+        if (!(sequence & 1))
+            return slot;
+    }
+}
+
+bool SharedFrameReader::stillValid(const SharedFrameSlot* slot, uint32_t sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
@@ -0,0 +1,143 @@
+//
+//  sharedring.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <string>
+
+// LIB includes
+#include "videosink.hpp"
+
+/*
+ Layout of the shared memory object, for readers in other processes (and other languages)
+ 
+ The object starts with a SharedRingHeader, followed by slotCount slots of slotSize bytes. Every integer is
+ native endian. Each slot is guarded by a seqlock: its sequence is odd while the slot is being written, so a
+ reader copies (or uses in place) a slot whose sequence was even and the same before and after the read.
+ */
+struct SharedRingHeader
+{
+    static constexpr uint32_t MAGIC = 0x4653454E; // "NESF"
+    static constexpr uint32_t VERSION = 1;
+    
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;                      // Distance between two slots in bytes
+    uint32_t width;
+    uint32_t height;
+    std::atomic<uint32_t> latestSlot;       // Slot of the newest complete frame
+    uint32_t reserved;
+    std::atomic<uint64_t> latestFrame;      // Frame number of the newest complete frame (0 before the first one)
+};
+
+struct alignas(64) SharedFrameSlot
+{
+    std::atomic<uint32_t> sequence;         // Odd while the slot is being written
+    uint32_t inputState;                    // Controller state the frame was emulated with
+    uint64_t frameNumber;
+    uint64_t hash;                          // hashFrame() of the pixels, to check reads or compare runs
+    std::array<RGBField, 512> palette;      // Emphasis LUT the pixels are resolved with
+    std::array<uint16_t, FrameBuffer::WIDTH * FrameBuffer::HEIGHT> pixels; // Same layout as FrameBuffer::pixels
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "Atomics shared between processes must be lock-free");
+
+/*
+ Sink that publishes every presented frame into a POSIX shared memory ring, for other processes on the same host
+ 
+ Readers map the ring and read frames in place: no copy, socket, or round trip through the emulator is needed.
+ The writer never waits on readers. It rotates through the slots, so a reader that is more than slotCount - 1
+ frames behind sees its slot's sequence change and moves on to the latest frame.
+ */
+class SharedFrameRing : public VideoSink
+{
+    std::string m_name;
+    SharedRingHeader* m_header;
+    size_t m_mappedSize;
+    uint32_t m_inputState;
+
+public:
+    
+    SharedFrameRing();
+    ~SharedFrameRing() override;
+    
+    SharedFrameRing(const SharedFrameRing&) = delete;
+    SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+    
+    /**
+     *  Creates (or replaces) the shared memory object
+     *
+     *  @param name Name of the object, starting with a '/' (e.g. "/nes_frames")
+     *  @param slotCount Frames kept in the ring (at least 2)
+     *  @return False if the object couldn't be created or mapped
+     */
+    bool create(const char* name, uint32_t slotCount = 4);
+    
+    // Unmaps and removes the shared memory object (readers that have it mapped keep their mapping)
+    void close();
+    
+    // Controller state stored along with the next frames
+    void setInputState(uint32_t state);
+    
+    // Copies the frame into the next slot and makes it the latest (does nothing if the ring isn't created)
+    void presentFrame(const FrameBuffer& frame, const Palette& palette) override;
+
+private:
+    
+    SharedFrameSlot* slot(uint32_t index) const;
+};
+
+/*
+ Reading side of a SharedFrameRing, for C++ consumers
+ */
+class SharedFrameReader
+{
+    const SharedRingHeader* m_header;
+    size_t m_mappedSize;
+
+public:
+    
+    SharedFrameReader();
+    ~SharedFrameReader();
+    
+    SharedFrameReader(const SharedFrameReader&) = delete;
+    SharedFrameReader& operator=(const SharedFrameReader&) = delete;
+    
+    /**
+     *  Maps an existing ring read only
+     *
+     *  @return False if the object doesn't exist or isn't a frame ring
+     */
+    bool open(const char* name);
+    void close();
+    
+    // Frame number of the newest complete frame (0 if none yet)
+    uint64_t latestFrame() const;
+    
+    /**
+     *  Copies the newest complete frame, retrying if the writer overwrites it during the copy
+     *
+     *  @param out Frame to copy into
+     *  @param palette Output emphasis LUT of the frame (nullptr to skip)
+     *  @param inputState Output controller state of the frame (nullptr to skip)
+     *  @return False if no frame was published yet
+     */
+    bool readLatest(FrameBuffer& out, std::array<RGBField, 512>* palette = nullptr, uint32_t* inputState = nullptr) const;
+    
+    /**
+     *  Zero copy access: the slot holding the newest frame, and its sequence before reading. After using the slot
+     *  in place, the read is valid only if stillValid() returns true for the same sequence.
+     *
+     *  @return nullptr if no frame was published yet
+     */
+    const SharedFrameSlot* acquireLatest(uint32_t& sequence) const;
+    bool stillValid(const SharedFrameSlot* slot, uint32_t sequence) const;
+};
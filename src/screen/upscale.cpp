@@ -0,0 +1,513 @@
+//
+//  upscale.cpp
+//  emulator_6502
+//
+
+#include "upscale.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <array>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UPSCALE_USE_SSE2 1
+#endif
+
+/* ---------- HELPERS ---------- */
+
+// Copies a row with its first and last pixels repeated once on each side (out must hold width + 2 pixels)
+static void padRow(const uint32_t* row, int width, uint32_t* out)
+{
+    out[0] = row[0];
+    std::memcpy(out + 1, row, width * sizeof(uint32_t));
+    out[width + 1] = row[width - 1];
+}
+
+/*
+ 3x3 neighbourhood of a pixel E:
+    A B C
+    D E F
+    G H I
+ */
+struct Neighbourhood
+{
+    uint32_t a, b, c, d, e, f, g, h, i;
+};
+
+static Neighbourhood neighbourhood(const uint32_t* up, const uint32_t* row, const uint32_t* down, int x)
+{
+    // Rows are padded, so x is the pixel to the left of E
+    return { up[x], up[x + 1], up[x + 2], row[x], row[x + 1], row[x + 2], down[x], down[x + 1], down[x + 2] };
+}
+
+static void scale2xPixel(const Neighbourhood& n, uint32_t* out0, uint32_t* out1)
+{
+    if (n.b != n.h && n.d != n.f)
+    {
+        out0[0] = (n.d == n.b) ? n.d : n.e;
+        out0[1] = (n.b == n.f) ? n.f : n.e;
+        out1[0] = (n.d == n.h) ? n.d : n.e;
+        out1[1] = (n.h == n.f) ? n.f : n.e;
+    }
+    else
+    {
+        out0[0] = out0[1] = out1[0] = out1[1] = n.e;
+    }
+}
+
+static void scale3xPixel(const Neighbourhood& n, uint32_t* out0, uint32_t* out1, uint32_t* out2)
+{
+    if (n.b != n.h && n.d != n.f)
+    {
+        const bool db = (n.d == n.b), bf = (n.b == n.f), dh = (n.d == n.h), hf = (n.h == n.f);
+        
+        out0[0] = db ? n.d : n.e;
+        out0[1] = ((db && n.e != n.c) || (bf && n.e != n.a)) ? n.b : n.e;
+        out0[2] = bf ? n.f : n.e;
+        out1[0] = ((db && n.e != n.g) || (dh && n.e != n.a)) ? n.d : n.e;
+        out1[1] = n.e;
+        out1[2] = ((bf && n.e != n.i) || (hf && n.e != n.c)) ? n.f : n.e;
+        out2[0] = dh ? n.d : n.e;
+        out2[1] = ((dh && n.e != n.i) || (hf && n.e != n.g)) ? n.h : n.e;
+        out2[2] = hf ? n.f : n.e;
+    }
+    else
+    {
+        std::fill(out0, out0 + 3, n.e);
+        std::fill(out1, out1 + 3, n.e);
+        std::fill(out2, out2 + 3, n.e);
+    }
+}
+
+#ifdef UPSCALE_USE_SSE2
+
+static inline __m128i load4(const uint32_t* pixels)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+}
+
+static inline void store4(uint32_t* pixels, __m128i value)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), value);
+}
+
+// mask ? a : b
+static inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Interleaves 3 vectors of 4 pixels into 12 pixels (x0 y0 z0 x1 y1 z1 ...)
+static inline void store3Interleaved(uint32_t* out, __m128i x, __m128i y, __m128i z)
+{
+    const __m128 xy = _mm_castsi128_ps(_mm_unpacklo_epi32(x, y));      // x0 y0 x1 y1
+    const __m128 xyHi = _mm_castsi128_ps(_mm_unpackhi_epi32(x, y));    // x2 y2 x3 y3
+    const __m128 zx = _mm_castsi128_ps(_mm_unpacklo_epi32(z, x));      // z0 x0 z1 x1
+    const __m128 yz = _mm_castsi128_ps(_mm_unpacklo_epi32(y, z));      // y0 z0 y1 z1
+    const __m128 zxHi = _mm_castsi128_ps(_mm_unpackhi_epi32(z, x));    // z2 x2 z3 x3
+    const __m128 yzHi = _mm_castsi128_ps(_mm_unpackhi_epi32(y, z));    // y2 z2 y3 z3
+    
+    store4(out, _mm_castps_si128(_mm_shuffle_ps(xy, zx, _MM_SHUFFLE(3, 0, 1, 0))));         // x0 y0 z0 x1
+    store4(out + 4, _mm_castps_si128(_mm_shuffle_ps(yz, xyHi, _MM_SHUFFLE(1, 0, 3, 2))));   // y1 z1 x2 y2
+    store4(out + 8, _mm_castps_si128(_mm_shuffle_ps(zxHi, yzHi, _MM_SHUFFLE(3, 2, 3, 0)))); // z2 x3 y3 z3
+}
+
+#endif
+
+/* ---------- UPSCALER ---------- */
+
+Upscaler::Upscaler(BandWorkers* workers) : m_workers(workers) {}
+
+int Upscaler::scaleOf(ScaleFilter filter, int nearestFactor)
+{
+    switch (filter)
+    {
+        case ScaleFilter::SCALE2X:
+            [[fallthrough]];
+        case ScaleFilter::XBR2X:
+            return 2;
+        case ScaleFilter::SCALE3X:
+            return 3;
+        default:
+            return std::clamp(nearestFactor, 1, 8);
+    }
+}
+
+void Upscaler::scale(ScaleFilter filter, const uint32_t* src, int width, int height, int srcPitch,
+                     uint32_t* dst, int dstPitch, int nearestFactor) const
+{
+    if (width <= 0 || height <= 0)
+        return;
+    
+    const ScaleJob job { src, width, height, srcPitch, dst, dstPitch, scaleOf(filter, nearestFactor) };
+    
+    void (*rows)(const ScaleJob&, int, int) = nullptr;
+    
+    switch (filter)
+    {
+        case ScaleFilter::SCALE2X:
+            rows = &Upscaler::scale2xRows;
+            break;
+        case ScaleFilter::SCALE3X:
+            rows = &Upscaler::scale3xRows;
+            break;
+        case ScaleFilter::XBR2X:
+            rows = &Upscaler::xbrRows;
+            break;
+        default:
+            rows = &Upscaler::nearestRows;
+            break;
+    }
+    
+    if (!m_workers)
+    {
+        rows(job, 0, height);
+        return;
+    }
+    
+    m_workers->run(height, [&job, rows](int firstRow, int endRow) { rows(job, firstRow, endRow); });
+}
+
+/* ---------- FILTERS ---------- */
+
+void Upscaler::nearestRows(const ScaleJob& job, int firstRow, int endRow)
+{
+    const int factor = job.factor;
+    const int outWidth = job.width * factor;
+    
+    for (int y = firstRow; y < endRow; ++y)
+    {
+        const uint32_t* row = job.src + (static_cast<size_t>(y) * job.srcPitch);
+        uint32_t* out = job.dst + (static_cast<size_t>(y) * factor * job.dstPitch);
+        int x = 0;
+
+#ifdef UPSCALE_USE_SSE2
+        // Broadcast each pixel into its factor copies with shuffles
+        if (factor == 2)
+        {
+            for (; x + 4 <= job.width; x += 4)
+            {
+                __m128i pixels = load4(row + x);
+                store4(out + (x * 2), _mm_unpacklo_epi32(pixels, pixels));
+                store4(out + (x * 2) + 4, _mm_unpackhi_epi32(pixels, pixels));
+            }
+        }
+        else if (factor == 3)
+        {
+            for (; x + 4 <= job.width; x += 4)
+            {
+                __m128i pixels = load4(row + x);
+                store3Interleaved(out + (x * 3), pixels, pixels, pixels);
+            }
+        }
+        else if (factor == 4)
+        {
+            for (; x + 4 <= job.width; x += 4)
+            {
+                __m128i pixels = load4(row + x);
+                store4(out + (x * 4), _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 0, 0, 0)));
+                store4(out + (x * 4) + 4, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 1, 1, 1)));
+                store4(out + (x * 4) + 8, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 2, 2)));
+                store4(out + (x * 4) + 12, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 3)));
+            }
+        }
+#endif
+        
+        for (; x < job.width; ++x)
+        {
+            std::fill(out + (x * factor), out + ((x + 1) * factor), row[x]);
+        }
+        
+        // The other rows of the pixel row are copies of the first one
+        for (int copy = 1; copy < factor; ++copy)
+        {
+            std::memcpy(out + (copy * job.dstPitch), out, outWidth * sizeof(uint32_t));
+        }
+    }
+}
+
+void Upscaler::scale2xRows(const ScaleJob& job, int firstRow, int endRow)
+{
+    std::vector<uint32_t> up(job.width + 2), row(job.width + 2), down(job.width + 2);
+    
+    for (int y = firstRow; y < endRow; ++y)
+    {
+        padRow(job.src + (static_cast<size_t>(std::max(y - 1, 0)) * job.srcPitch), job.width, up.data());
+        padRow(job.src + (static_cast<size_t>(y) * job.srcPitch), job.width, row.data());
+        padRow(job.src + (static_cast<size_t>(std::min(y + 1, job.height - 1)) * job.srcPitch), job.width, down.data());
+        
+        uint32_t* out0 = job.dst + (static_cast<size_t>(y) * 2 * job.dstPitch);
+        uint32_t* out1 = out0 + job.dstPitch;
+        int x = 0;
+
+#ifdef UPSCALE_USE_SSE2
+        for (; x + 4 <= job.width; x += 4)
+        {
+            const __m128i b = load4(up.data() + x + 1);
+            const __m128i d = load4(row.data() + x);
+            const __m128i e = load4(row.data() + x + 1);
+            const __m128i f = load4(row.data() + x + 2);
+            const __m128i h = load4(down.data() + x + 1);
+            
+            const __m128i db = _mm_cmpeq_epi32(d, b), bf = _mm_cmpeq_epi32(b, f);
+            const __m128i dh = _mm_cmpeq_epi32(d, h), hf = _mm_cmpeq_epi32(h, f);
+            
+            // Same rules as scale2xPixel(): a corner takes the color of the two neighbours it sits between
+            // when they match and the opposite neighbours don't
+            const __m128i e0 = select(_mm_andnot_si128(_mm_or_si128(bf, dh), db), d, e);
+            const __m128i e1 = select(_mm_andnot_si128(_mm_or_si128(db, hf), bf), f, e);
+            const __m128i e2 = select(_mm_andnot_si128(_mm_or_si128(db, hf), dh), d, e);
+            const __m128i e3 = select(_mm_andnot_si128(_mm_or_si128(dh, bf), hf), f, e);
+            
+            store4(out0 + (x * 2), _mm_unpacklo_epi32(e0, e1));
+            store4(out0 + (x * 2) + 4, _mm_unpackhi_epi32(e0, e1));
+            store4(out1 + (x * 2), _mm_unpacklo_epi32(e2, e3));
+            store4(out1 + (x * 2) + 4, _mm_unpackhi_epi32(e2, e3));
+        }
+#endif
+        
+        for (; x < job.width; ++x)
+        {
+            scale2xPixel(neighbourhood(up.data(), row.data(), down.data(), x), out0 + (x * 2), out1 + (x * 2));
+        }
+    }
+}
+
+void Upscaler::scale3xRows(const ScaleJob& job, int firstRow, int endRow)
+{
+    std::vector<uint32_t> up(job.width + 2), row(job.width + 2), down(job.width + 2);
+    
+    for (int y = firstRow; y < endRow; ++y)
+    {
+        padRow(job.src + (static_cast<size_t>(std::max(y - 1, 0)) * job.srcPitch), job.width, up.data());
+        padRow(job.src + (static_cast<size_t>(y) * job.srcPitch), job.width, row.data());
+        padRow(job.src + (static_cast<size_t>(std::min(y + 1, job.height - 1)) * job.srcPitch), job.width, down.data());
+        
+        uint32_t* out0 = job.dst + (static_cast<size_t>(y) * 3 * job.dstPitch);
+        uint32_t* out1 = out0 + job.dstPitch;
+        uint32_t* out2 = out1 + job.dstPitch;
+        int x = 0;
+
+#ifdef UPSCALE_USE_SSE2
+        for (; x + 4 <= job.width; x += 4)
+        {
+            const __m128i a = load4(up.data() + x), b = load4(up.data() + x + 1), c = load4(up.data() + x + 2);
+            const __m128i d = load4(row.data() + x), e = load4(row.data() + x + 1), f = load4(row.data() + x + 2);
+            const __m128i g = load4(down.data() + x), h = load4(down.data() + x + 1), i = load4(down.data() + x + 2);
+            
+            const __m128i db = _mm_cmpeq_epi32(d, b), bf = _mm_cmpeq_epi32(b, f);
+            const __m128i dh = _mm_cmpeq_epi32(d, h), hf = _mm_cmpeq_epi32(h, f);
+            
+            // Corner conditions, as in scale3xPixel()
+            const __m128i c0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+            const __m128i c2 = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+            const __m128i c6 = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+            const __m128i c8 = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+            
+            const __m128i ea = _mm_cmpeq_epi32(e, a), ec = _mm_cmpeq_epi32(e, c);
+            const __m128i eg = _mm_cmpeq_epi32(e, g), ei = _mm_cmpeq_epi32(e, i);
+            
+            const __m128i e1 = select(_mm_or_si128(_mm_andnot_si128(ec, c0), _mm_andnot_si128(ea, c2)), b, e);
+            const __m128i e3 = select(_mm_or_si128(_mm_andnot_si128(eg, c0), _mm_andnot_si128(ea, c6)), d, e);
+            const __m128i e5 = select(_mm_or_si128(_mm_andnot_si128(ei, c2), _mm_andnot_si128(ec, c8)), f, e);
+            const __m128i e7 = select(_mm_or_si128(_mm_andnot_si128(ei, c6), _mm_andnot_si128(eg, c8)), h, e);
+            
+            store3Interleaved(out0 + (x * 3), select(c0, d, e), e1, select(c2, f, e));
+            store3Interleaved(out1 + (x * 3), e3, e, e5);
+            store3Interleaved(out2 + (x * 3), select(c6, d, e), e7, select(c8, f, e));
+        }
+#endif
+        
+        for (; x < job.width; ++x)
+        {
+            scale3xPixel(neighbourhood(up.data(), row.data(), down.data(), x), out0 + (x * 3), out1 + (x * 3), out2 + (x * 3));
+        }
+    }
+}
+
+void Upscaler::xbrRows(const ScaleJob& job, int firstRow, int endRow)
+{
+    // Source rows the band reads, padded by 2 pixels on every side (edges repeated) so no offset needs clamping
+    constexpr int PAD = 2;
+    const int stride = job.width + (2 * PAD);
+    const int rows = (endRow - firstRow) + (2 * PAD);
+    const size_t size = static_cast<size_t>(rows) * stride;
+    
+    std::vector<uint32_t> pixels(size);
+    std::vector<int32_t> luma(size), chromaU(size), chromaV(size);
+    
+    for (int row = 0; row < rows; ++row)
+    {
+        const int y = std::clamp(firstRow - PAD + row, 0, job.height - 1);
+        const uint32_t* src = job.src + (static_cast<size_t>(y) * job.srcPitch);
+        
+        for (int col = 0; col < stride; ++col)
+        {
+            const size_t index = (static_cast<size_t>(row) * stride) + col;
+            const uint32_t pixel = src[std::clamp(col - PAD, 0, job.width - 1)];
+            const uint8_t* rgba = reinterpret_cast<const uint8_t*>(&pixel);
+            const int r = rgba[0], g = rgba[1], b = rgba[2];
+            
+            pixels[index] = pixel;
+            luma[index] = (77 * r + 150 * g + 29 * b) >> 8;
+            chromaU[index] = (-43 * r - 85 * g + 128 * b) >> 8;
+            chromaV[index] = (128 * r - 107 * g - 21 * b) >> 8;
+        }
+    }
+    
+    /*
+     Every distance the rules use is between two adjacent pixels, so the distance of each pixel to its right,
+     bottom, bottom right and bottom left neighbours is computed once (luma dominates, like the eye)
+     */
+    enum { RIGHT, DOWN, DOWN_RIGHT, DOWN_LEFT, DIRECTIONS };
+    const int steps[DIRECTIONS] = { 1, stride, stride + 1, stride - 1 };
+    std::array<std::vector<int32_t>, DIRECTIONS> distances;
+    
+    for (int direction = 0; direction < DIRECTIONS; ++direction)
+    {
+        distances[direction].assign(size, 0);
+        
+        for (size_t p = 0; p + steps[direction] < size; ++p)
+        {
+            const size_t q = p + steps[direction];
+            distances[direction][p] = (48 * std::abs(luma[p] - luma[q])) + (7 * std::abs(chromaU[p] - chromaU[q])) +
+                                      (6 * std::abs(chromaV[p] - chromaV[q]));
+        }
+    }
+    
+    /*
+     Neighbourhood used by the rules of the bottom right corner (E is the pixel being scaled):
+          .  .  .
+       .  A  B  C  .
+       .  D  E  F  F4
+       .  G  H  I  I4
+          .  H5 I5
+     The other corners mirror it horizontally and/or vertically.
+     */
+    struct Point { int x, y; };
+    constexpr Point E = { 0, 0 }, B = { 0, -1 }, C = { 1, -1 }, D = { -1, 0 }, F = { 1, 0 }, G = { -1, 1 };
+    constexpr Point H = { 0, 1 }, I = { 1, 1 }, F4 = { 2, 0 }, I4 = { 2, 1 }, H5 = { 0, 2 }, I5 = { 1, 2 };
+    
+    // Pairs of pixels whose distance the rules need: the first 5 weigh an edge along F-H, the next 5 one along E-I,
+    // and the last 2 pick between F and H
+    enum { EDGE_FH = 0, EDGE_EI = 5, TO_F = 10, TO_H = 11, TERMS = 12 };
+    constexpr Point PAIRS[TERMS][2] = {
+        { E, C }, { E, G }, { I, F4 }, { I, H5 }, { H, F },
+        { H, D }, { H, I5 }, { F, I4 }, { F, B }, { E, I },
+        { E, F }, { E, H }
+    };
+    
+    // Where each distance is found, relative to the pixel being scaled, per corner (top left, top right, bottom left, bottom right)
+    const int32_t* termPlanes[4][TERMS];
+    int termOffsets[4][TERMS];
+    int offsetF[4], offsetH[4];
+    
+    for (int corner = 0; corner < 4; ++corner)
+    {
+        const int sx = (corner & 0x01) ? 1 : -1;
+        const int sy = (corner & 0x02) ? 1 : -1;
+        
+        offsetF[corner] = F.x * sx;
+        offsetH[corner] = H.y * sy * stride;
+        
+        for (int term = 0; term < TERMS; ++term)
+        {
+            Point p = { PAIRS[term][0].x * sx, PAIRS[term][0].y * sy };
+            Point q = { PAIRS[term][1].x * sx, PAIRS[term][1].y * sy };
+            
+            // Distances are stored on the upper (then leftmost) pixel of the pair
+            if (q.y < p.y || (q.y == p.y && q.x < p.x))
+                std::swap(p, q);
+            
+            const int dx = q.x - p.x, dy = q.y - p.y;
+            const int direction = (dy == 0) ? RIGHT : (dx == 0) ? DOWN : (dx > 0) ? DOWN_RIGHT : DOWN_LEFT;
+            
+            termPlanes[corner][term] = distances[direction].data();
+            termOffsets[corner][term] = p.x + (p.y * stride);
+        }
+    }
+    
+    // Average of two pixels per channel, without carries between channels
+    auto blend = [](uint32_t a, uint32_t b) { return (a & b) + (((a ^ b) & 0xFEFEFEFE) >> 1); };
+    
+    for (int y = firstRow; y < endRow; ++y)
+    {
+        const size_t rowStart = (static_cast<size_t>(y - firstRow + PAD) * stride) + PAD;
+        uint32_t* out0 = job.dst + (static_cast<size_t>(y) * 2 * job.dstPitch);
+        uint32_t* out1 = out0 + job.dstPitch;
+        int x = 0;
+
+#ifdef UPSCALE_USE_SSE2
+        for (; x + 4 <= job.width; x += 4)
+        {
+            const size_t p = rowStart + x;
+            const __m128i e = load4(&pixels[p]);
+            __m128i corners[4];
+            
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                auto term = [&](int t)
+                {
+                    return load4(reinterpret_cast<const uint32_t*>(termPlanes[corner][t] + p + termOffsets[corner][t]));
+                };
+                
+                // Same rules as the scalar loop below
+                __m128i edgeFH = _mm_slli_epi32(term(EDGE_FH + 4), 2);
+                __m128i edgeEI = _mm_slli_epi32(term(EDGE_EI + 4), 2);
+                
+                for (int t = 0; t < 4; ++t)
+                {
+                    edgeFH = _mm_add_epi32(edgeFH, term(EDGE_FH + t));
+                    edgeEI = _mm_add_epi32(edgeEI, term(EDGE_EI + t));
+                }
+                
+                const __m128i takeH = _mm_cmpgt_epi32(term(TO_F), term(TO_H));
+                const __m128i closer = select(takeH, load4(&pixels[p + offsetH[corner]]), load4(&pixels[p + offsetF[corner]]));
+                const __m128i blended = _mm_add_epi32(_mm_and_si128(e, closer),
+                                        _mm_srli_epi32(_mm_and_si128(_mm_xor_si128(e, closer), _mm_set1_epi32(static_cast<int>(0xFEFEFEFE))), 1));
+                
+                corners[corner] = select(_mm_cmplt_epi32(edgeFH, edgeEI), blended, e);
+            }
+            
+            store4(out0 + (x * 2), _mm_unpacklo_epi32(corners[0], corners[1]));
+            store4(out0 + (x * 2) + 4, _mm_unpackhi_epi32(corners[0], corners[1]));
+            store4(out1 + (x * 2), _mm_unpacklo_epi32(corners[2], corners[3]));
+            store4(out1 + (x * 2) + 4, _mm_unpackhi_epi32(corners[2], corners[3]));
+        }
+#endif
+        
+        for (; x < job.width; ++x)
+        {
+            const size_t p = rowStart + x;
+            const uint32_t e = pixels[p];
+            uint32_t* corners[4] = { out0 + (x * 2), out0 + (x * 2) + 1, out1 + (x * 2), out1 + (x * 2) + 1 };
+            
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                auto term = [&](int t) { return termPlanes[corner][t][p + termOffsets[corner][t]]; };
+                
+                // Low when an edge runs along F-H (F close to H, and each side of it uniform), or along E-I
+                int edgeFH = 4 * term(EDGE_FH + 4);
+                int edgeEI = 4 * term(EDGE_EI + 4);
+                
+                for (int t = 0; t < 4; ++t)
+                {
+                    edgeFH += term(EDGE_FH + t);
+                    edgeEI += term(EDGE_EI + t);
+                }
+                
+                *corners[corner] = e;
+                
+                if (edgeFH < edgeEI)
+                {
+                    // The corner is cut by the edge: blend in the closer of F and H
+                    const int closer = (term(TO_F) <= term(TO_H)) ? offsetF[corner] : offsetH[corner];
+                    *corners[corner] = blend(e, pixels[p + closer]);
+                }
+            }
+        }
+    }
+}
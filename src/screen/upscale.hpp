@@ -0,0 +1,82 @@
+//
+//  upscale.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// LIB includes
+#include "../util/bandworkers.hpp"
+
+enum class ScaleFilter
+{
+    NEAREST,    // Integer nearest neighbour (any factor)
+    SCALE2X,    // EPX / Scale2x
+    SCALE3X,    // Scale3x
+    XBR2X       // 2xBR style edge detection with blended corners
+};
+
+/*
+ Pixel art upscalers, used as a post processing stage on RGBA frames (the GUI output, or the NTSC filter output)
+ 
+ Pixels are handled as packed 32 bit RGBA values, so the edge rules only compare whole pixels for equality.
+ Every filter processes 4 pixels at a time with SSE2 (with a scalar path for other targets and the end of
+ each row). Rows are split into horizontal bands across the worker threads: every output row only
+ depends on a few source rows, so bands never wait on each other.
+ */
+class Upscaler
+{
+    /*
+     Source and destination of one scaling call (pitches are in pixels)
+     */
+    struct ScaleJob
+    {
+        const uint32_t* src;
+        int width;
+        int height;
+        int srcPitch;
+        uint32_t* dst;
+        int dstPitch;
+        int factor;
+    };
+    
+    BandWorkers* m_workers;
+
+public:
+    
+    /**
+     *  @param workers Pool the rows of each frame are split across (nullptr scales on the calling thread only)
+     */
+    Upscaler(BandWorkers* workers = nullptr);
+    
+    /**
+     *  Scale factor of a filter
+     *
+     *  @param nearestFactor Factor used by NEAREST (ignored by the other filters)
+     */
+    static int scaleOf(ScaleFilter filter, int nearestFactor = 2);
+    
+    /**
+     *  Scales an RGBA image into a caller provided buffer
+     *
+     *  @param src Source pixels
+     *  @param width Width of the source in pixels
+     *  @param height Height of the source in pixels
+     *  @param srcPitch Distance between two source rows, in pixels
+     *  @param dst Destination. Must hold (height * scale) rows of dstPitch pixels, with dstPitch >= width * scale
+     *  @param dstPitch Distance between two destination rows, in pixels
+     *  @param nearestFactor Factor used by NEAREST (1-8)
+     */
+    void scale(ScaleFilter filter, const uint32_t* src, int width, int height, int srcPitch,
+               uint32_t* dst, int dstPitch, int nearestFactor = 2) const;
+
+private:
+    
+    // Scales source rows [firstRow, endRow) of a job
+    static void nearestRows(const ScaleJob& job, int firstRow, int endRow);
+    static void scale2xRows(const ScaleJob& job, int firstRow, int endRow);
+    static void scale3xRows(const ScaleJob& job, int firstRow, int endRow);
+    static void xbrRows(const ScaleJob& job, int firstRow, int endRow);
+};
@@ -0,0 +1,41 @@
+//
+//  videosink.cpp
+//  emulator_6502
+//
+
+#include "videosink.hpp"
+
+/* ---------- NULL SINK ---------- */
+
+void NullVideoSink::presentFrame(const FrameBuffer& /*frame*/, const Palette& /*palette*/) {}
+
+/* ---------- MEMORY SINK ---------- */
+
+MemoryVideoSink::MemoryVideoSink() : m_framesPresented(0) {}
+
+void MemoryVideoSink::presentFrame(const FrameBuffer& frame, const Palette& palette)
+{
+    m_frame = frame;
+    m_palette = palette;
+    m_framesPresented++;
+}
+
+const FrameBuffer& MemoryVideoSink::getFrame() const
+{
+    return m_frame;
+}
+
+const Palette& MemoryVideoSink::getPalette() const
+{
+    return m_palette;
+}
+
+void MemoryVideoSink::copyRGBA(uint8_t* out) const
+{
+    m_frame.toRGBA(m_palette, out);
+}
+
+uint64_t MemoryVideoSink::getFramesPresented() const
+{
+    return m_framesPresented;
+}
@@ -0,0 +1,80 @@
+//
+//  videosink.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// LIB includes
+#include "../PPU/framebuffer.hpp"
+
+/*
+ Destination of the frames the PPU presents
+ 
+ Only the SFML window (GUI) needs a display, so the PPU and the console only know about this interface:
+ headless builds use the null or in-memory sinks and never touch SFML.
+ */
+class VideoSink
+{
+public:
+    virtual ~VideoSink() = default;
+    
+    /**
+     *  Receives a frame from the PPU. The frame is only valid during the call, so sinks copy what they keep.
+     *
+     *  @param frame Indexed frame outputted by the PPU
+     *  @param palette Palette used to resolve the color and emphasis bits of each pixel
+     */
+    virtual void presentFrame(const FrameBuffer& frame, const Palette& palette) = 0;
+    
+    // Whether the sink still accepts frames (false once a window is closed)
+    virtual bool running() const { return true; }
+    
+    // Game loop functions, for sinks that have events to process or something to draw
+    virtual void update() {}
+    virtual void render() {}
+};
+
+/*
+ Sink that discards every frame, for batch jobs that only need the emulation
+ */
+class NullVideoSink : public VideoSink
+{
+public:
+    void presentFrame(const FrameBuffer& frame, const Palette& palette) override;
+};
+
+/*
+ Sink that keeps the latest frame in memory, for tests and tools that inspect the output
+ 
+ The indexed frame is copied as is; it is only expanded to RGBA when asked for.
+ */
+class MemoryVideoSink : public VideoSink
+{
+    FrameBuffer m_frame;
+    Palette m_palette;
+    uint64_t m_framesPresented;
+
+public:
+    MemoryVideoSink();
+    
+    void presentFrame(const FrameBuffer& frame, const Palette& palette) override;
+    
+    // Latest frame presented (blank until the first one)
+    const FrameBuffer& getFrame() const;
+    
+    // Palette the latest frame was presented with
+    const Palette& getPalette() const;
+    
+    /**
+     *  Expands the latest frame into RGBA (4 bytes per pixel, alpha always 0xFF)
+     *
+     *  @param out Destination buffer. Must hold at least FrameBuffer::WIDTH * FrameBuffer::HEIGHT * 4 bytes
+     */
+    void copyRGBA(uint8_t* out) const;
+    
+    // Number of frames presented so far
+    uint64_t getFramesPresented() const;
+};
@@ -10,13 +10,16 @@
 #include <iostream>
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 class Memory
 {
     std::unique_ptr<uint8_t[]> m_data;
+    size_t m_size;
     
 public:
-    Memory(uint16_t size) : m_data(new uint8_t[size]()) {}
+    Memory(uint16_t size) : m_data(new uint8_t[size]()), m_size(size) {}
 
     // Access operator
     uint8_t& operator[](uint16_t address)
@@ -37,6 +40,26 @@ public:
         return getBaseAddress() + mirroredAddress(address);
     }
     
+    // Size of the backing storage in bytes (mirrors aren't stored)
+    size_t getSize() const
+    {
+        return m_size;
+    }
+    
+    /*
+     Snapshot helpers: copy the whole backing storage out of / into a buffer
+     (only the storage, not what read()/write() side effects are wired to)
+     */
+    void saveContents(std::vector<uint8_t>& out) const
+    {
+        out.assign(m_data.get(), m_data.get() + m_size);
+    }
+    
+    void loadContents(const std::vector<uint8_t>& in)
+    {
+        std::copy_n(in.begin(), std::min(in.size(), m_size), m_data.get());
+    }
+    
     /*
      Memory mirroring mimicker:
      It mimics the act of memory mirroring by returning the mirrored value from the base position than actual position
@@ -71,5 +94,21 @@ public:
     {
         m_data[mirroredAddress(addr)] = data;
     }
+    
+    /**
+     *  Tells the memory at which CPU cycle the accesses of the current instruction happen. Memory with timed side
+     *  effects (like the CPU bus, which catches the PPU up before touching it) overrides this. Does nothing by default.
+     *
+     *  @param cycle CPU cycle since power up
+     */
+    virtual void setAccessCycle(uint64_t /*cycle*/) {}
+    
+    /**
+     *  Gets the cycles the CPU has to stall for because of the current instruction's accesses (e.g. OAM DMA),
+     *  and clears them. No access stalls the CPU by default.
+     *
+     *  @return Extra CPU cycles to add to the instruction
+     */
+    virtual int takeStallCycles() { return 0; }
 };
 
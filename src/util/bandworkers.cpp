@@ -0,0 +1,108 @@
+//
+//  bandworkers.cpp
+//  emulator_6502
+//
+
+#include "bandworkers.hpp"
+
+#include <algorithm>
+
+BandWorkers::BandWorkers(int threads)
+    : m_job(nullptr), m_rows(0), m_bands(threads + 1), m_generation(0), m_pending(0), m_stopping(false)
+{
+    for (int i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back(&BandWorkers::workerLoop, this, i + 1);
+    }
+}
+
+BandWorkers::~BandWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    
+    m_jobReady.notify_all();
+    
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void BandWorkers::run(int rows, const std::function<void(int, int)>& job)
+{
+    if (m_threads.empty() || rows < m_bands)
+    {
+        job(0, rows);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_rows = rows;
+        m_pending = m_bands - 1;
+        m_generation++;
+    }
+    
+    m_jobReady.notify_all();
+    
+    // The calling thread takes the first band
+    int first, end;
+    bandRows(0, first, end);
+    job(first, end);
+    
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobDone.wait(lock, [this] { return m_pending == 0; });
+    m_job = nullptr;
+}
+
+int BandWorkers::bandCount() const
+{
+    return m_bands;
+}
+
+int BandWorkers::defaultThreadCount()
+{
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency())) - 1;
+}
+
+/* ---------- PRIVATE FUNCTIONS ---------- */
+
+void BandWorkers::bandRows(int band, int& first, int& end) const
+{
+    first = (m_rows * band) / m_bands;
+    end = (m_rows * (band + 1)) / m_bands;
+}
+
+void BandWorkers::workerLoop(int band)
+{
+    uint64_t lastGeneration = 0;
+    
+    while (true)
+    {
+        const std::function<void(int, int)>* job;
+        int first, end;
+        
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobReady.wait(lock, [this, lastGeneration] { return m_stopping || m_generation != lastGeneration; });
+            
+            if (m_stopping)
+                return;
+            
+            lastGeneration = m_generation;
+            job = m_job;
+            bandRows(band, first, end);
+        }
+        
+        (*job)(first, end);
+        
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        if (--m_pending == 0)
+            m_jobDone.notify_one();
+    }
+}
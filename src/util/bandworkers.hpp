@@ -0,0 +1,71 @@
+//
+//  bandworkers.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ Pool of threads that split a per-row job (video filters, scalers) into horizontal bands
+ 
+ The threads are started once and sleep between jobs. The calling thread works on the first band itself,
+ so a pool of N threads keeps N + 1 cores busy.
+ */
+class BandWorkers
+{
+    std::vector<std::thread> m_threads;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_jobDone;
+    
+    // Current job, only valid while m_pending > 0
+    const std::function<void(int, int)>* m_job;
+    int m_rows;
+    int m_bands;
+    
+    uint64_t m_generation; // Bumped for every job, so each worker runs it exactly once
+    int m_pending;         // Bands of the current job that aren't done yet
+    bool m_stopping;
+
+public:
+    
+    /**
+     *  @param threads Extra threads to start (0 runs every job on the calling thread)
+     */
+    BandWorkers(int threads = defaultThreadCount());
+    ~BandWorkers();
+    
+    BandWorkers(const BandWorkers&) = delete;
+    BandWorkers& operator=(const BandWorkers&) = delete;
+    
+    /**
+     *  Splits rows [0, rows) into contiguous bands, runs job(firstRow, endRow) on each band in parallel,
+     *  and returns once every band is done.
+     *
+     *  @param rows Number of rows to process
+     *  @param job Called once per band with a half open range of rows. Bands never overlap
+     */
+    void run(int rows, const std::function<void(int, int)>& job);
+    
+    // Number of bands a job gets split into
+    int bandCount() const;
+    
+    // One thread per core, minus the calling thread
+    static int defaultThreadCount();
+
+private:
+    
+    // Rows [first, end) of a band
+    void bandRows(int band, int& first, int& end) const;
+    
+    // Body of each worker thread (band = index of the thread + 1)
+    void workerLoop(int band);
+};
@@ -7,14 +7,15 @@
 
 #include "cpumem.hpp"
 
-CPUMemory::CPUMemory(PPU* ppu) : Memory(0xFFFF), ppu(ppu) {}
+CPUMemory::CPUMemory(PPU* ppu) : Memory(0xFFFF), ppu(ppu), m_controllers(nullptr), m_accessCycle(0),
+    m_stallCycles(0), m_cpuClockDivider(NTSCTiming::CPU_CLOCK_DIVIDER), m_ppuClockDivider(NTSCTiming::PPU_CLOCK_DIVIDER) {}
 
 uint16_t CPUMemory::mirroredAddress(uint16_t address) const
 {
     if (address < 0x2000)
         return address % 0x0800; // CPU Ram is mirrored every 2KB
     else if (address < 0x4000)
-        return (address % 0x2008); // PPU Memory mirrored every byte, starting at 0x2000
+        return 0x2000 + (address & 0x07); // PPU registers mirrored every 8 bytes, starting at 0x2000
     
     return address;
 }
@@ -22,7 +23,17 @@ uint16_t CPUMemory::mirroredAddress(uint16_t address) const
 uint8_t CPUMemory::read(uint16_t address) const
 {
     if (address >= 0x2000 && address < 0x4000)
+    {
+        // The PPU only runs when it is observed: bring it up to the current cycle first
+        ppu->catchUp(accessDot());
         return ppu->read(mirroredAddress(address)); // Specific read functions attached to the PPU
+    }
+    
+    if ((address == 0x4016 || address == 0x4017) && m_controllers)
+    {
+        // Upper bits are open bus, which usually holds the high byte of the address ($40)
+        return 0x40 | m_controllers->read(address - 0x4016);
+    }
     
     // TODO: Implement specific read side effects for APU
     
@@ -32,9 +43,66 @@ uint8_t CPUMemory::read(uint16_t address) const
 void CPUMemory::write(uint16_t address, uint8_t value) const
 {
     if (address >= 0x2000 && address < 0x4000)
+    {
+        ppu->catchUp(accessDot());
         ppu->write(mirroredAddress(address), value); // Specific write functions attached to the PPU
+    }
+    else if (address == 0x4014)
+    {
+        ppu->catchUp(accessDot());
+        
+        // OAM DMA: Copy page $XX00-$XXFF into OAM
+        std::array<uint8_t, 256> page;
+        for (int i = 0; i < 256; ++i)
+        {
+            page[i] = read((static_cast<uint16_t>(value) << 8) | i);
+        }
+        
+        ppu->write(address, value);
+        ppu->writeOAMDMA(page);
+        
+        // The CPU is halted while the 256 bytes are copied: 513 cycles, plus one to align with a read cycle when the
+        // write lands on an odd cycle
+        m_stallCycles += 513 + static_cast<int>(m_accessCycle & 1);
+    }
+    else if (address == 0x4016 && m_controllers)
+    {
+        // Queued input is applied at the strobe, timed by the cycle of the write
+        m_controllers->writeStrobe(value, m_accessCycle);
+    }
     else
         Memory::write(address, value); // Access own memory if not a specific address
     
     // TODO: Implement specific write side effects for APU
 }
+
+void CPUMemory::setAccessCycle(uint64_t cycle)
+{
+    m_accessCycle = cycle;
+}
+
+int CPUMemory::takeStallCycles()
+{
+    int cycles = m_stallCycles;
+    m_stallCycles = 0;
+    return cycles;
+}
+
+void CPUMemory::setRegion(Region region)
+{
+    withRegionTiming(region, [this](auto timing)
+    {
+        m_cpuClockDivider = decltype(timing)::CPU_CLOCK_DIVIDER;
+        m_ppuClockDivider = decltype(timing)::PPU_CLOCK_DIVIDER;
+    });
+}
+
+void CPUMemory::setControllers(ControllerPorts* controllers)
+{
+    m_controllers = controllers;
+}
+
+uint64_t CPUMemory::accessDot() const
+{
+    return (m_accessCycle * m_cpuClockDivider) / m_ppuClockDivider;
+}
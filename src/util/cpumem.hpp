@@ -9,11 +9,25 @@
 
 #include "abstract/memory.h"
 #include "../PPU/PPU.hpp"
+#include "../input/controller.hpp"
 
 class CPUMemory : public Memory
 {
     PPU* ppu;
     
+    // Controllers behind $4016/$4017 (optional)
+    ControllerPorts* m_controllers;
+    
+    // CPU cycle the current instruction accesses memory at
+    uint64_t m_accessCycle;
+    
+    // Cycles the CPU is halted for by an OAM DMA started by the current instruction (written from the const write())
+    mutable int m_stallCycles;
+    
+    // Master clock dividers of the region, to convert CPU cycles into PPU dots
+    int m_cpuClockDivider;
+    int m_ppuClockDivider;
+    
 public:
     
     CPUMemory(PPU* ppu);
@@ -23,4 +37,17 @@ public:
     uint8_t read(uint16_t address) const override;
     void write(uint16_t address, uint8_t value) const override;
     
+    void setAccessCycle(uint64_t cycle) override;
+    int takeStallCycles() override;
+    
+    // Sets the CPU:PPU clock ratio used to catch the PPU up (NTSC by default)
+    void setRegion(Region region);
+    
+    // Plugs the controller ports in (nullptr reads $4016/$4017 as plain memory)
+    void setControllers(ControllerPorts* controllers);
+
+private:
+    
+    // PPU dot the current access happens at
+    uint64_t accessDot() const;
 };
@@ -0,0 +1,553 @@
+//
+//  deflate.cpp
+//  emulator_6502
+//
+
+#include "deflate.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <queue>
+
+static constexpr int LITERAL_CODES = 286;
+static constexpr int DISTANCE_CODES = 30;
+static constexpr int LENGTH_CODES = 19;
+static constexpr int END_OF_BLOCK = 256;
+
+static constexpr uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static constexpr uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static constexpr uint16_t DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+    6145, 8193, 12289, 16385, 24577
+};
+static constexpr uint8_t DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Order the code length code lengths are stored in
+static constexpr uint8_t LENGTH_ORDER[LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Index of the largest base <= value
+template <size_t N>
+static int baseIndex(const uint16_t (&bases)[N], int value)
+{
+    return static_cast<int>(std::upper_bound(bases, bases + N, value) - bases) - 1;
+}
+
+static inline uint32_t hash3(const uint8_t* bytes, int bits)
+{
+    const uint32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+    return (value * 2654435761u) >> (32 - bits);
+}
+
+Deflater::Deflater(int maxChain) : m_maxChain(std::max(maxChain, 1)), m_out(nullptr), m_bitBuffer(0), m_bitCount(0) {}
+
+/* ---------- ZLIB STREAM ---------- */
+
+void Deflater::compressZlib(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    out.clear();
+    m_out = &out;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    
+    // 32 KB window, default compression
+    out.push_back(0x78);
+    out.push_back(0x9C);
+    
+    findMatches(data, size);
+    
+    if (m_symbols.empty())
+    {
+        writeBlock(0, 0, true);
+    }
+    
+    for (size_t first = 0; first < m_symbols.size(); first += SYMBOLS_PER_BLOCK)
+    {
+        const size_t end = std::min(first + SYMBOLS_PER_BLOCK, m_symbols.size());
+        writeBlock(first, end, end == m_symbols.size());
+    }
+    
+    flushBits();
+    
+    const uint32_t adler = adler32(data, size);
+    out.push_back(static_cast<uint8_t>(adler >> 24));
+    out.push_back(static_cast<uint8_t>(adler >> 16));
+    out.push_back(static_cast<uint8_t>(adler >> 8));
+    out.push_back(static_cast<uint8_t>(adler));
+    
+    m_out = nullptr;
+}
+
+uint32_t Deflater::crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> entries {};
+        
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t value = n;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+            }
+            entries[n] = value;
+        }
+        
+        return entries;
+    }();
+    
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    
+    return ~crc;
+}
+
+uint32_t Deflater::adler32(const uint8_t* data, size_t size, uint32_t adler)
+{
+    // Largest run of bytes that can't overflow the sums before the modulo
+    static constexpr size_t NMAX = 5552;
+    
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    
+    while (size)
+    {
+        const size_t chunk = std::min(size, NMAX);
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        
+        a %= 65521;
+        b %= 65521;
+        data += chunk;
+        size -= chunk;
+    }
+    
+    return (b << 16) | a;
+}
+
+/* ---------- LZ77 ---------- */
+
+void Deflater::findMatches(const uint8_t* data, size_t size)
+{
+    m_head.assign(1 << HASH_BITS, -1);
+    m_prev.assign(WINDOW_SIZE, -1);
+    m_symbols.clear();
+    
+    auto insert = [&](size_t pos)
+    {
+        if (pos + MIN_MATCH > size)
+            return;
+        
+        const uint32_t hash = hash3(data + pos, HASH_BITS);
+        m_prev[pos & (WINDOW_SIZE - 1)] = m_head[hash];
+        m_head[hash] = static_cast<int32_t>(pos);
+    };
+    
+    size_t pos = 0;
+    
+    while (pos < size)
+    {
+        int distance = 0;
+        const int length = longestMatch(data, size, pos, distance);
+        insert(pos);
+        
+        if (length < MIN_MATCH)
+        {
+            m_symbols.push_back({ 0, data[pos] });
+            ++pos;
+            continue;
+        }
+        
+        // Lazy matching: a longer match starting on the next byte is worth a literal
+        int nextDistance = 0;
+        if (longestMatch(data, size, pos + 1, nextDistance) > length)
+        {
+            m_symbols.push_back({ 0, data[pos] });
+            ++pos;
+            continue;
+        }
+        
+        m_symbols.push_back({ static_cast<uint16_t>(length), static_cast<uint16_t>(distance) });
+        
+        for (size_t skipped = pos + 1; skipped < pos + length; ++skipped)
+        {
+            insert(skipped);
+        }
+        
+        pos += length;
+    }
+}
+
+int Deflater::longestMatch(const uint8_t* data, size_t size, size_t pos, int& distance) const
+{
+    if (pos + MIN_MATCH > size)
+        return 0;
+    
+    const int maxLength = static_cast<int>(std::min<size_t>(MAX_MATCH, size - pos));
+    const uint8_t* current = data + pos;
+    
+    int bestLength = 0;
+    int32_t candidate = m_head[hash3(current, HASH_BITS)];
+    
+    for (int chain = 0; chain < m_maxChain && candidate >= 0; ++chain)
+    {
+        // Older positions have been overwritten in m_prev, so the chain ends at the window
+        if (pos - candidate >= WINDOW_SIZE)
+            break;
+        
+        const uint8_t* previous = data + candidate;
+        
+        if (previous[bestLength] == current[bestLength] && previous[0] == current[0])
+        {
+            int length = 0;
+            while (length < maxLength && previous[length] == current[length])
+            {
+                ++length;
+            }
+            
+            if (length > bestLength)
+            {
+                bestLength = length;
+                distance = static_cast<int>(pos - candidate);
+                
+                if (length == maxLength)
+                    break;
+            }
+        }
+        
+        candidate = m_prev[candidate & (WINDOW_SIZE - 1)];
+    }
+    
+    return (bestLength >= MIN_MATCH) ? bestLength : 0;
+}
+
+/* ---------- HUFFMAN BLOCKS ---------- */
+
+void Deflater::writeBlock(size_t first, size_t end, bool last)
+{
+    std::vector<uint32_t> literalCounts(LITERAL_CODES, 0);
+    std::vector<uint32_t> distanceCounts(DISTANCE_CODES, 0);
+    
+    for (size_t i = first; i < end; ++i)
+    {
+        const Symbol& symbol = m_symbols[i];
+        
+        if (symbol.length == 0)
+        {
+            ++literalCounts[symbol.value];
+        }
+        else
+        {
+            ++literalCounts[257 + baseIndex(LENGTH_BASE, symbol.length)];
+            ++distanceCounts[baseIndex(DISTANCE_BASE, symbol.value)];
+        }
+    }
+    
+    ++literalCounts[END_OF_BLOCK];
+    
+    std::vector<uint8_t> literalLengths, distanceLengths;
+    buildLengths(literalCounts, 15, literalLengths);
+    buildLengths(distanceCounts, 15, distanceLengths);
+    
+    // A block without matches still needs a distance code
+    if (std::all_of(distanceLengths.begin(), distanceLengths.end(), [](uint8_t length) { return length == 0; }))
+    {
+        distanceLengths[0] = 1;
+        distanceLengths[1] = 1;
+    }
+    
+    int literalCount = LITERAL_CODES;
+    while (literalCount > 257 && literalLengths[literalCount - 1] == 0)
+    {
+        --literalCount;
+    }
+    
+    int distanceCount = DISTANCE_CODES;
+    while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+    {
+        --distanceCount;
+    }
+    
+    // Both code lengths sequences are run length encoded together (16: repeat previous, 17/18: runs of zeros)
+    std::vector<uint8_t> sequence(literalLengths.begin(), literalLengths.begin() + literalCount);
+    sequence.insert(sequence.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCount);
+    
+    struct LengthSymbol
+    {
+        uint8_t code;
+        uint8_t extra;
+    };
+    
+    std::vector<LengthSymbol> encoded;
+    std::vector<uint32_t> lengthCounts(LENGTH_CODES, 0);
+    
+    for (size_t i = 0; i < sequence.size();)
+    {
+        const uint8_t length = sequence[i];
+        size_t run = 1;
+        
+        while (i + run < sequence.size() && sequence[i + run] == length)
+        {
+            ++run;
+        }
+        
+        size_t left = run;
+        
+        if (length == 0)
+        {
+            while (left >= 11)
+            {
+                const size_t count = std::min<size_t>(left, 138);
+                encoded.push_back({ 18, static_cast<uint8_t>(count - 11) });
+                left -= count;
+            }
+            
+            if (left >= 3)
+            {
+                encoded.push_back({ 17, static_cast<uint8_t>(left - 3) });
+                left = 0;
+            }
+        }
+        else
+        {
+            encoded.push_back({ length, 0 });
+            --left;
+            
+            while (left >= 3)
+            {
+                const size_t count = std::min<size_t>(left, 6);
+                encoded.push_back({ 16, static_cast<uint8_t>(count - 3) });
+                left -= count;
+            }
+        }
+        
+        for (; left > 0; --left)
+        {
+            encoded.push_back({ length, 0 });
+        }
+        
+        i += run;
+    }
+    
+    for (const LengthSymbol& symbol : encoded)
+    {
+        ++lengthCounts[symbol.code];
+    }
+    
+    std::vector<uint8_t> lengthLengths;
+    buildLengths(lengthCounts, 7, lengthLengths);
+    
+    int lengthCount = LENGTH_CODES;
+    while (lengthCount > 4 && lengthLengths[LENGTH_ORDER[lengthCount - 1]] == 0)
+    {
+        --lengthCount;
+    }
+    
+    std::vector<uint16_t> literalCodes, distanceCodes, lengthCodes;
+    buildCodes(literalLengths, literalCodes);
+    buildCodes(distanceLengths, distanceCodes);
+    buildCodes(lengthLengths, lengthCodes);
+    
+    // Block header
+    writeBits(last ? 1 : 0, 1);
+    writeBits(2, 2);
+    writeBits(literalCount - 257, 5);
+    writeBits(distanceCount - 1, 5);
+    writeBits(lengthCount - 4, 4);
+    
+    for (int i = 0; i < lengthCount; ++i)
+    {
+        writeBits(lengthLengths[LENGTH_ORDER[i]], 3);
+    }
+    
+    static constexpr int REPEAT_EXTRA_BITS[3] = { 2, 3, 7 };
+    
+    for (const LengthSymbol& symbol : encoded)
+    {
+        writeBits(lengthCodes[symbol.code], lengthLengths[symbol.code]);
+        
+        if (symbol.code >= 16)
+            writeBits(symbol.extra, REPEAT_EXTRA_BITS[symbol.code - 16]);
+    }
+    
+    // Block data
+    for (size_t i = first; i < end; ++i)
+    {
+        const Symbol& symbol = m_symbols[i];
+        
+        if (symbol.length == 0)
+        {
+            writeBits(literalCodes[symbol.value], literalLengths[symbol.value]);
+            continue;
+        }
+        
+        const int lengthIndex = baseIndex(LENGTH_BASE, symbol.length);
+        const int distanceIndex = baseIndex(DISTANCE_BASE, symbol.value);
+        
+        writeBits(literalCodes[257 + lengthIndex], literalLengths[257 + lengthIndex]);
+        writeBits(symbol.length - LENGTH_BASE[lengthIndex], LENGTH_EXTRA[lengthIndex]);
+        writeBits(distanceCodes[distanceIndex], distanceLengths[distanceIndex]);
+        writeBits(symbol.value - DISTANCE_BASE[distanceIndex], DISTANCE_EXTRA[distanceIndex]);
+    }
+    
+    writeBits(literalCodes[END_OF_BLOCK], literalLengths[END_OF_BLOCK]);
+}
+
+void Deflater::buildLengths(const std::vector<uint32_t>& counts, int maxLength, std::vector<uint8_t>& lengths)
+{
+    lengths.assign(counts.size(), 0);
+    
+    std::vector<int> used;
+    for (size_t symbol = 0; symbol < counts.size(); ++symbol)
+    {
+        if (counts[symbol])
+            used.push_back(static_cast<int>(symbol));
+    }
+    
+    if (used.empty())
+        return;
+    
+    // A single code still needs one bit, and a second code makes the code complete
+    if (used.size() == 1)
+    {
+        lengths[used[0]] = 1;
+        lengths[used[0] == 0 ? 1 : 0] = 1;
+        return;
+    }
+    
+    std::vector<uint64_t> weights(used.size());
+    for (size_t i = 0; i < used.size(); ++i)
+    {
+        weights[i] = counts[used[i]];
+    }
+    
+    // Build the Huffman tree, and flatten the counts until no code is longer than maxLength
+    while (true)
+    {
+        using Node = std::pair<uint64_t, int>;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        std::vector<int> parents(used.size(), -1);
+        
+        for (size_t i = 0; i < used.size(); ++i)
+        {
+            queue.push({ weights[i], static_cast<int>(i) });
+        }
+        
+        while (queue.size() > 1)
+        {
+            const Node a = queue.top();
+            queue.pop();
+            const Node b = queue.top();
+            queue.pop();
+            
+            const int parent = static_cast<int>(parents.size());
+            parents.push_back(-1);
+            parents[a.second] = parent;
+            parents[b.second] = parent;
+            queue.push({ a.first + b.first, parent });
+        }
+        
+        // Parents are created after their children, so depths can be filled from the root down
+        std::vector<int> depths(parents.size(), 0);
+        for (int node = static_cast<int>(parents.size()) - 2; node >= 0; --node)
+        {
+            depths[node] = depths[parents[node]] + 1;
+        }
+        
+        const int longest = *std::max_element(depths.begin(), depths.begin() + used.size());
+        
+        if (longest <= maxLength)
+        {
+            for (size_t i = 0; i < used.size(); ++i)
+            {
+                lengths[used[i]] = static_cast<uint8_t>(depths[i]);
+            }
+            
+            return;
+        }
+        
+        for (uint64_t& weight : weights)
+        {
+            weight = (weight >> 1) | 1;
+        }
+    }
+}
+
+void Deflater::buildCodes(const std::vector<uint8_t>& lengths, std::vector<uint16_t>& codes)
+{
+    std::array<uint16_t, 16> lengthCounts {};
+    for (uint8_t length : lengths)
+    {
+        ++lengthCounts[length];
+    }
+    
+    lengthCounts[0] = 0;
+    
+    std::array<uint16_t, 16> nextCode {};
+    uint16_t code = 0;
+    
+    for (int length = 1; length < 16; ++length)
+    {
+        code = static_cast<uint16_t>((code + lengthCounts[length - 1]) << 1);
+        nextCode[length] = code;
+    }
+    
+    codes.assign(lengths.size(), 0);
+    
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol)
+    {
+        const int length = lengths[symbol];
+        if (length == 0)
+            continue;
+        
+        // Huffman codes are stored most significant bit first, in a stream that is otherwise LSB first
+        const uint16_t canonical = nextCode[length]++;
+        uint16_t reversed = 0;
+        
+        for (int bit = 0; bit < length; ++bit)
+        {
+            reversed |= ((canonical >> bit) & 1) << (length - 1 - bit);
+        }
+        
+        codes[symbol] = reversed;
+    }
+}
+
+/* ---------- BIT OUTPUT ---------- */
+
+void Deflater::writeBits(uint32_t bits, int count)
+{
+    m_bitBuffer |= static_cast<uint64_t>(bits) << m_bitCount;
+    m_bitCount += count;
+    
+    while (m_bitCount >= 8)
+    {
+        m_out->push_back(static_cast<uint8_t>(m_bitBuffer));
+        m_bitBuffer >>= 8;
+        m_bitCount -= 8;
+    }
+}
+
+void Deflater::flushBits()
+{
+    if (m_bitCount > 0)
+        m_out->push_back(static_cast<uint8_t>(m_bitBuffer));
+    
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+}
@@ -0,0 +1,97 @@
+//
+//  deflate.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ Small DEFLATE (RFC 1951) compressor with a zlib (RFC 1950) wrapper, for writing PNGs without external libraries
+ 
+ Matches are found with hash chains over the 32 KB window, with one step of lazy matching. Every block gets its own
+ dynamic Huffman codes, built from the symbol counts of the block and limited to the lengths DEFLATE allows.
+ Emulator frames are large areas of repeated tiles, so this lands close to zlib's default level.
+ */
+class Deflater
+{
+    static constexpr int WINDOW_SIZE = 1 << 15;
+    static constexpr int HASH_BITS = 15;
+    static constexpr int MIN_MATCH = 3;
+    static constexpr int MAX_MATCH = 258;
+    static constexpr size_t SYMBOLS_PER_BLOCK = 1 << 15;
+    
+    /*
+     Literal (length = 0) or match, as found by the LZ77 pass
+     */
+    struct Symbol
+    {
+        uint16_t length;
+        uint16_t value;     // Literal byte, or match distance
+    };
+    
+    // Longest chain followed per position (higher compresses better, but slower)
+    int m_maxChain;
+    
+    std::vector<int32_t> m_head;    // Latest position of each hash
+    std::vector<int32_t> m_prev;    // Previous position with the same hash, per window position
+    std::vector<Symbol> m_symbols;
+    
+    // Output bit buffer (DEFLATE packs bits starting from the least significant one)
+    std::vector<uint8_t>* m_out;
+    uint64_t m_bitBuffer;
+    int m_bitCount;
+
+public:
+    
+    /**
+     *  @param maxChain Longest hash chain followed per position
+     */
+    Deflater(int maxChain = 128);
+    
+    /**
+     *  Compresses data into a zlib stream (what PNG IDAT chunks hold)
+     *
+     *  @param data Bytes to compress
+     *  @param size Number of bytes
+     *  @param out Replaced with the compressed stream (its capacity is reused)
+     */
+    void compressZlib(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+    
+    /**
+     *  Checksums used by zlib and PNG
+     *
+     *  @param crc Running value, to checksum data in several pieces (start from 0 / 1)
+     */
+    static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+    static uint32_t adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+
+private:
+    
+    // LZ77 pass over the whole input into m_symbols
+    void findMatches(const uint8_t* data, size_t size);
+    
+    // Longest match for the position, 0 if shorter than MIN_MATCH
+    int longestMatch(const uint8_t* data, size_t size, size_t pos, int& distance) const;
+    
+    // Writes m_symbols [first, end) as one dynamic Huffman block
+    void writeBlock(size_t first, size_t end, bool last);
+    
+    /**
+     *  Builds length limited Huffman code lengths from symbol counts
+     *
+     *  @param counts Count of each symbol
+     *  @param maxLength Longest code allowed
+     *  @param lengths Output code length of each symbol (0 for unused symbols)
+     */
+    static void buildLengths(const std::vector<uint32_t>& counts, int maxLength, std::vector<uint8_t>& lengths);
+    
+    // Canonical codes from code lengths, already bit reversed for the LSB first stream
+    static void buildCodes(const std::vector<uint8_t>& lengths, std::vector<uint16_t>& codes);
+    
+    void writeBits(uint32_t bits, int count);
+    void flushBits();
+};
@@ -51,7 +51,13 @@ uint16_t PPUMemory::mirroredAddress(uint16_t address) const
     else if (address >= 0x3F00 && address < 0x4000)
     {
         // $3F00-$3F1F is mirrored every 0x20
-        return (address % 0x20) + 0x3F00;
+        uint16_t paletteAddr = (address % 0x20) + 0x3F00;
+        
+        // $3F10/$3F14/$3F18/$3F1C are mirrors of $3F00/$3F04/$3F08/$3F0C
+        if ((paletteAddr & 0x13) == 0x10)
+            paletteAddr -= 0x10;
+        
+        return paletteAddr;
     }
     
     return address;
@@ -0,0 +1,128 @@
+//
+//  region.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+
+// Console regions, numbered like Header::timingMode
+enum class Region { NTSC = 0, PAL = 1, MULTI = 2, DENDY = 3 };
+
+/*
+ Timing constants of each region
+
+ Everything is known at compile time, so code templated on one of these structs gets its scanline and frame
+ limits folded into constants instead of reading them from member variables on every dot.
+
+ Clocks are given as dividers of the master clock: a CPU cycle lasts CPU_CLOCK_DIVIDER master clocks and a
+ PPU dot lasts PPU_CLOCK_DIVIDER, which gives the exact CPU:PPU ratio (3 on NTSC/Dendy, 3.2 on PAL).
+ */
+struct NTSCTiming
+{
+    static constexpr Region REGION = Region::NTSC;
+
+    static constexpr double MASTER_CLOCK_HZ = 236250000.0 / 11.0;
+    static constexpr int CPU_CLOCK_DIVIDER = 12;
+    static constexpr int PPU_CLOCK_DIVIDER = 4;
+
+    static constexpr int DOTS_PER_SCANLINE = 341;
+    static constexpr int SCANLINES_PER_FRAME = 262;
+    static constexpr int VBLANK_SCANLINE = 241;         // Vblank flag and NMI raised on dot 1 of this line
+    static constexpr int VBLANK_SCANLINES = 20;
+    static constexpr int PRE_RENDER_SCANLINE = 261;
+    static constexpr bool SKIPS_ODD_FRAME_DOT = true;   // Pre-render line is a dot shorter on odd frames
+
+    // APU frame counter steps, in CPU cycles (4 step sequence, then the last step of the 5 step sequence)
+    static constexpr std::array<int, 4> APU_FRAME_STEPS = { 7457, 14913, 22371, 29829 };
+    static constexpr int APU_FIVE_STEP_PERIOD = 37281;
+};
+
+struct PALTiming
+{
+    static constexpr Region REGION = Region::PAL;
+
+    static constexpr double MASTER_CLOCK_HZ = 26601712.5;
+    static constexpr int CPU_CLOCK_DIVIDER = 16;
+    static constexpr int PPU_CLOCK_DIVIDER = 5;
+
+    static constexpr int DOTS_PER_SCANLINE = 341;
+    static constexpr int SCANLINES_PER_FRAME = 312;
+    static constexpr int VBLANK_SCANLINE = 241;
+    static constexpr int VBLANK_SCANLINES = 70;
+    static constexpr int PRE_RENDER_SCANLINE = 311;
+    static constexpr bool SKIPS_ODD_FRAME_DOT = false;
+
+    static constexpr std::array<int, 4> APU_FRAME_STEPS = { 8313, 16627, 24939, 33253 };
+    static constexpr int APU_FIVE_STEP_PERIOD = 41565;
+};
+
+/*
+ Dendy (UA6538): PAL frame length with NTSC CPU:PPU ratio. Vblank starts 51 lines after the visible frame
+ so it still lasts 20 lines, and the APU keeps NTSC periods.
+ */
+struct DendyTiming
+{
+    static constexpr Region REGION = Region::DENDY;
+
+    static constexpr double MASTER_CLOCK_HZ = 26601712.5;
+    static constexpr int CPU_CLOCK_DIVIDER = 15;
+    static constexpr int PPU_CLOCK_DIVIDER = 5;
+
+    static constexpr int DOTS_PER_SCANLINE = 341;
+    static constexpr int SCANLINES_PER_FRAME = 312;
+    static constexpr int VBLANK_SCANLINE = 291;
+    static constexpr int VBLANK_SCANLINES = 20;
+    static constexpr int PRE_RENDER_SCANLINE = 311;
+    static constexpr bool SKIPS_ODD_FRAME_DOT = false;
+
+    static constexpr std::array<int, 4> APU_FRAME_STEPS = NTSCTiming::APU_FRAME_STEPS;
+    static constexpr int APU_FIVE_STEP_PERIOD = NTSCTiming::APU_FIVE_STEP_PERIOD;
+};
+
+// PPU dots elapsed after a number of CPU cycles (rounded down)
+template <typename Timing>
+constexpr uint64_t cpuCyclesToDots(uint64_t cycles)
+{
+    return (cycles * Timing::CPU_CLOCK_DIVIDER) / Timing::PPU_CLOCK_DIVIDER;
+}
+
+// First CPU cycle at which at least a number of PPU dots have elapsed
+template <typename Timing>
+constexpr uint64_t dotsToCpuCycles(uint64_t dots)
+{
+    return ((dots * Timing::PPU_CLOCK_DIVIDER) + Timing::CPU_CLOCK_DIVIDER - 1) / Timing::CPU_CLOCK_DIVIDER;
+}
+
+// Frames per second the console outputs (60.0988 on NTSC, where odd frames are half a dot shorter on average)
+template <typename Timing>
+constexpr double framesPerSecond()
+{
+    constexpr double dotsPerFrame = (Timing::DOTS_PER_SCANLINE * Timing::SCANLINES_PER_FRAME) -
+                                    (Timing::SKIPS_ODD_FRAME_DOT ? 0.5 : 0.0);
+    
+    return Timing::MASTER_CLOCK_HZ / (dotsPerFrame * Timing::PPU_CLOCK_DIVIDER);
+}
+
+/**
+ *  Calls visitor with the timing struct of a region (as an empty value, use decltype to get the type).
+ *  This is the one place a runtime region is turned into a compile time one. Multi-region games run as NTSC.
+ *
+ *  @param region Region to dispatch on
+ *  @param visitor Generic callable, e.g. [&](auto timing) { using Timing = decltype(timing); ... }
+ */
+template <typename Visitor>
+decltype(auto) withRegionTiming(Region region, Visitor&& visitor)
+{
+    switch (region)
+    {
+        case Region::PAL:
+            return visitor(PALTiming {});
+        case Region::DENDY:
+            return visitor(DendyTiming {});
+        default:
+            return visitor(NTSCTiming {});
+    }
+}
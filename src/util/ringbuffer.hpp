@@ -0,0 +1,81 @@
+//
+//  ringbuffer.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <array>
+#include <atomic>
+
+/*
+ Lock-free single producer, single consumer ring buffer
+ 
+ One thread may only push and one other thread may only pop. Head and tail are kept on separate cache lines
+ so the two threads don't fight over the same line. Capacity must be a power of 2.
+ */
+template <typename T, size_t Capacity>
+class RingBuffer
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of 2");
+    
+    std::array<T, Capacity> m_data;
+    
+    alignas(64) std::atomic<size_t> m_head { 0 }; // Next slot to pop (owned by consumer)
+    alignas(64) std::atomic<size_t> m_tail { 0 }; // Next slot to push (owned by producer)
+    
+public:
+    
+    /**
+     *  Pushes an item (producer only)
+     *
+     *  @return False if the buffer is full
+     */
+    bool push(const T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        
+        m_data[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    
+    /**
+     *  Pops an item (consumer only)
+     *
+     *  @return False if the buffer is empty
+     */
+    bool pop(T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        
+        item = m_data[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+    
+    /// Blocks the consumer until the buffer is no longer empty (must be woken by notify())
+    void waitForData() const
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        m_tail.wait(head, std::memory_order_acquire);
+    }
+    
+    /// Wakes up a consumer blocked in waitForData()
+    void notify()
+    {
+        m_tail.notify_one();
+    }
+};
@@ -0,0 +1,55 @@
+//
+//  scheduler.cpp
+//  emulator_6502
+//
+
+#include "scheduler.hpp"
+
+Scheduler::Scheduler()
+{
+    m_eventDots.fill(NOT_SCHEDULED);
+}
+
+void Scheduler::schedule(EventType type, uint64_t dot)
+{
+    uint64_t& scheduled = m_eventDots[static_cast<int>(type)];
+    
+    // Rescheduling at the same dot would only add a duplicate entry
+    if (scheduled == dot)
+        return;
+    
+    scheduled = dot;
+    m_heap.push({dot, type});
+}
+
+void Scheduler::cancel(EventType type)
+{
+    m_eventDots[static_cast<int>(type)] = NOT_SCHEDULED;
+}
+
+uint64_t Scheduler::nextEventDot()
+{
+    discardStale();
+    return m_heap.empty() ? NOT_SCHEDULED : m_heap.top().first;
+}
+
+bool Scheduler::popDue(uint64_t now, EventType& type)
+{
+    discardStale();
+    
+    if (m_heap.empty() || m_heap.top().first > now)
+        return false;
+    
+    type = m_heap.top().second;
+    m_heap.pop();
+    m_eventDots[static_cast<int>(type)] = NOT_SCHEDULED;
+    return true;
+}
+
+void Scheduler::discardStale()
+{
+    while (!m_heap.empty() && m_eventDots[static_cast<int>(m_heap.top().second)] != m_heap.top().first)
+    {
+        m_heap.pop();
+    }
+}
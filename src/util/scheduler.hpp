@@ -0,0 +1,75 @@
+//
+//  scheduler.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <queue>
+#include <vector>
+
+/*
+ Everything that can interrupt the CPU or needs a component to be synced at a precise time.
+ Each type has at most one pending event.
+ */
+enum class EventType
+{
+    NMI,                // PPU vblank NMI (or an NMI that is already pending)
+    FRAME_END,          // PPU finished the visible part of a frame
+    SPRITE_ZERO_HIT,    // Predicted sprite 0 hit of the current frame
+    FRAME_IRQ,          // APU frame counter IRQ
+    DMC_FETCH,          // APU DMC sample fetch
+    MAPPER_IRQ,         // Mapper scanline/cycle IRQ
+    COUNT
+};
+
+/*
+ Master clock event scheduler, indexed in PPU dots since power up
+ 
+ Events sit in a binary heap. Cancelling or moving an event doesn't touch the heap: the old entry is simply
+ ignored once it reaches the top, so events that rarely fire cost nothing until they do.
+ */
+class Scheduler
+{
+    using Entry = std::pair<uint64_t, EventType>;
+    
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_heap;
+    
+    // Dot each event type is currently scheduled at (NOT_SCHEDULED if cancelled)
+    std::array<uint64_t, static_cast<int>(EventType::COUNT)> m_eventDots;
+    
+public:
+    static constexpr uint64_t NOT_SCHEDULED = UINT64_MAX;
+    
+    Scheduler();
+    
+    /**
+     *  Schedules an event, replacing any pending event of the same type
+     *
+     *  @param type Type of event
+     *  @param dot Master clock dot the event fires at
+     */
+    void schedule(EventType type, uint64_t dot);
+    
+    /// Cancels the pending event of this type, if any
+    void cancel(EventType type);
+    
+    /// Dot of the earliest pending event (NOT_SCHEDULED if there is none)
+    uint64_t nextEventDot();
+    
+    /**
+     *  Removes the earliest event if it is due
+     *
+     *  @param now Current master clock dot
+     *  @param type Output type of the event that fired
+     *  @return True if an event fired
+     */
+    bool popDue(uint64_t now, EventType& type);
+    
+private:
+    
+    // Drops heap entries that were cancelled or rescheduled
+    void discardStale();
+};
@@ -0,0 +1,78 @@
+//
+//  triplebuffer.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+
+/*
+ Lock-free triple buffer between one writer and one reader
+ 
+ The writer fills the back buffer and publishes it, which swaps it with the middle buffer. The reader swaps the
+ middle buffer with its front buffer whenever a newer one was published. Neither side ever waits: the writer
+ always has a buffer the reader can't be looking at, and the reader always gets the newest complete one
+ (older unread ones are dropped).
+ */
+template <typename T>
+class TripleBuffer
+{
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    static constexpr uint8_t FRESH = 0x04;  // Set on the middle index when it holds a buffer the reader hasn't taken
+    
+    std::array<T, 3> m_buffers;
+    
+    alignas(64) std::atomic<uint8_t> m_middle { 1 };
+    alignas(64) uint8_t m_back = 0;     // Owned by the writer
+    alignas(64) uint8_t m_front = 2;    // Owned by the reader
+
+public:
+    
+    /// Buffer the writer fills (writer only)
+    T& back()
+    {
+        return m_buffers[m_back];
+    }
+    
+    /**
+     *  Hands the back buffer over to the reader, and takes the middle buffer as the new back buffer (writer only).
+     *  The new back buffer holds an older frame, so the writer must fully rewrite it.
+     *
+     *  @return False if the previously published buffer was never read (it got dropped)
+     */
+    bool publish()
+    {
+        const uint8_t previous = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+        return !(previous & FRESH);
+    }
+    
+    /**
+     *  Takes the newest published buffer, if there is one the reader doesn't have yet (reader only)
+     *
+     *  @return True if front() changed
+     */
+    bool update()
+    {
+        if (!hasNew())
+            return false;
+        
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    
+    /// Buffer the reader owns (reader only)
+    const T& front() const
+    {
+        return m_buffers[m_front];
+    }
+    
+    /// Whether a buffer was published since the last update()
+    bool hasNew() const
+    {
+        return m_middle.load(std::memory_order_relaxed) & FRESH;
+    }
+};
@@ -0,0 +1,49 @@
+//
+//  check.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include <cstdio>
+
+/*
+ Minimal checks for the standalone test programs in this folder
+ 
+ Each test is its own executable, built with the sources it needs, e.g.:
+    c++ -std=c++20 tests/cpu_interrupts.cpp <CPU, PPU, util and console sources>
+ and exits with a non zero status when any check fails.
+ */
+inline int g_checkFailures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            g_checkFailures++; \
+        } \
+    } while (0)
+
+// Both sides are compared as long long, so sizes and int literals can be mixed without sign warnings
+#define CHECK_EQ(a, b) \
+    do { \
+        long long checkA = static_cast<long long>(a); \
+        long long checkB = static_cast<long long>(b); \
+        if (checkA != checkB) \
+        { \
+            std::fprintf(stderr, "%s:%d: check failed: %s == %s (%lld vs %lld)\n", __FILE__, __LINE__, #a, #b, \
+                         checkA, checkB); \
+            g_checkFailures++; \
+        } \
+    } while (0)
+
+inline int checkResult(const char* name)
+{
+    if (g_checkFailures)
+        std::fprintf(stderr, "%s: %d check(s) failed\n", name, g_checkFailures);
+    else
+        std::printf("%s: ok\n", name);
+    
+    return g_checkFailures ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+//
+//  console_frames.cpp
+//  emulator_6502
+//
+
+#include "check.hpp"
+#include "helpers.hpp"
+#include "../src/console/console.hpp"
+#include "../src/screen/videosink.hpp"
+#include "../src/PPU/framehash.hpp"
+
+/*
+ runFrame() advances exactly one PPU frame and presents every one of them, even when a register access catches the
+ PPU up past the end of the frame before the FRAME_END event is serviced
+ */
+
+static void testPollLoop(bool nmi)
+{
+    MemoryVideoSink sink;
+    FrameHashLog log;
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, &sink);
+    console.setFrameHashLog(&log);
+    cpu6502& cpu = console.getCPU();
+    
+    load(cpu, 0x8000, { 0xA9, static_cast<uint8_t>(nmi ? 0x80 : 0x00), 0x8D, 0x00, 0x20,   // LDA #$80/#$00, STA $2000
+                        0xA9, 0x1E, 0x8D, 0x01, 0x20,                                      // LDA #$1E, STA $2001
+                        0x2C, 0x02, 0x20,                                                  // loop: BIT $2002
+                        0x4C, 0x0A, 0x80 });                                               // JMP loop
+    load(cpu, 0x8100, { 0x40 });                                                           // RTI
+    cpu.memory[0xFFFA] = 0x00;
+    cpu.memory[0xFFFB] = 0x81;
+    cpu.pc.val = 0x8000;
+    
+    PPU& ppu = console.getPPU();
+    
+    for (int frame = 1; frame <= 200; frame++)
+    {
+        console.runFrame();
+        
+        CHECK_EQ(ppu.getFrameCount(), frame);
+        CHECK_EQ(sink.getFramesPresented(), frame);
+    }
+    
+    // One hash per PPU frame, none missing
+    CHECK_EQ(log.getHashes().size(), 200);
+    CHECK_EQ(log.getMissingFrames(), 0);
+    
+    for (size_t i = 0; i < log.getFrameNumbers().size(); i++)
+        CHECK_EQ(log.getFrameNumbers()[i], i + 1);
+}
+
+int main()
+{
+    silenceTrace();
+    
+    testPollLoop(false);
+    testPollLoop(true);
+    
+    return checkResult("console_frames");
+}
@@ -0,0 +1,37 @@
+//
+//  console_region.cpp
+//  emulator_6502
+//
+
+#include "check.hpp"
+#include "../src/console/console.hpp"
+#include "../src/loader/rom_params.hpp"
+
+/*
+ makeConsole() picks the region from the timing field of NES 2.0 headers only. iNES 1.0 headers have no such field,
+ and dumps tagged "DiskDude!" put an ASCII 'u' in its place.
+ */
+
+static Region regionOf(bool nes2_0, uint8_t byte12)
+{
+    Header header {};
+    header.format.iNES = 1;
+    header.format.nes2_0 = nes2_0;
+    header.timingMode = byte12;     // Loader keeps the low 2 bits
+    
+    return makeConsole(header, nullptr)->getRegion();
+}
+
+int main()
+{
+    // Multiple-region games run as NTSC
+    CHECK(regionOf(true, 0) == Region::NTSC);
+    CHECK(regionOf(true, 1) == Region::PAL);
+    CHECK(regionOf(true, 2) == Region::NTSC);
+    CHECK(regionOf(true, 3) == Region::DENDY);
+    
+    for (uint8_t byte12 : { 0, 1, 2, 3, 'u' & 0x03 })
+        CHECK(regionOf(false, byte12) == Region::NTSC);
+    
+    return checkResult("console_region");
+}
@@ -0,0 +1,106 @@
+//
+//  cpu_interrupts.cpp
+//  emulator_6502
+//
+
+#include "check.hpp"
+#include "helpers.hpp"
+#include "../src/console/console.hpp"
+
+/*
+ NMI / IRQ / BRK return addresses: RTI has to resume exactly where the interrupt left off
+ */
+
+// NMI taken right after a 3 byte instruction returns to the following instruction
+static void testNMIAfterMultiByteInstruction()
+{
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, nullptr);
+    cpu6502& cpu = console.getCPU();
+    
+    load(cpu, 0x8005, { 0x2C, 0x02, 0x20 });    // BIT $2002
+    load(cpu, 0x8100, { 0xE6, 0x10, 0x40 });    // INC $10, RTI
+    cpu.memory[0xFFFA] = 0x00;
+    cpu.memory[0xFFFB] = 0x81;
+    
+    cpu.pc.val = 0x8005;
+    cpu.emulate();
+    CHECK_EQ(cpu.pc.val, 0x8008);
+    
+    uint8_t stack = cpu.s;
+    cpu.interrupt_handler(InterruptType::NMI);
+    CHECK_EQ(cpu.pc.val, 0x8100);
+    
+    cpu.emulate();
+    cpu.emulate();
+    CHECK_EQ(cpu.pc.val, 0x8008);
+    CHECK_EQ(cpu.s, stack);
+    CHECK_EQ(cpu.memory[0x10], 1);
+}
+
+// BRK skips its padding byte
+static void testBRKReturnAddress()
+{
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, nullptr);
+    cpu6502& cpu = console.getCPU();
+    
+    load(cpu, 0x8200, { 0x00, 0xEA });  // BRK, padding
+    load(cpu, 0x8300, { 0x40 });        // RTI
+    cpu.memory[0xFFFE] = 0x00;
+    cpu.memory[0xFFFF] = 0x83;
+    
+    cpu.pc.val = 0x8200;
+    cpu.ps.i = 0;
+    
+    uint8_t stack = cpu.s;
+    cpu.emulate();
+    CHECK_EQ(cpu.pc.val, 0x8300);
+    
+    cpu.emulate();
+    CHECK_EQ(cpu.pc.val, 0x8202);
+    CHECK_EQ(cpu.s, stack);
+}
+
+// A $2002 poll loop with NMIs on takes one NMI per frame and never drifts into the middle of an instruction
+static void testNMIPollLoop()
+{
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, nullptr);
+    cpu6502& cpu = console.getCPU();
+    
+    load(cpu, 0x8000, { 0xA9, 0x80, 0x8D, 0x00, 0x20,      // LDA #$80, STA $2000
+                        0x2C, 0x02, 0x20,                  // loop: BIT $2002
+                        0x4C, 0x05, 0x80 });               // JMP loop
+    load(cpu, 0x8100, { 0xE6, 0x10, 0x40 });                // INC $10, RTI
+    cpu.memory[0xFFFA] = 0x00;
+    cpu.memory[0xFFFB] = 0x81;
+    cpu.pc.val = 0x8000;
+    
+    constexpr uint64_t cyclesPerFrame = dotsToCpuCycles<NTSCTiming>(NTSCTiming::DOTS_PER_SCANLINE *
+                                                                   NTSCTiming::SCANLINES_PER_FRAME);
+    
+    for (int frame = 0; frame < 200; frame++)
+    {
+        console.runCycles(cyclesPerFrame);
+        
+        // Between frames the CPU is either in the loop or in the handler, on an instruction boundary
+        uint16_t pc = cpu.pc.val;
+        CHECK(pc == 0x8005 || pc == 0x8008 || pc == 0x8100 || pc == 0x8102);
+    }
+    
+    // VBlank is set at power up, so enabling NMIs raises one right away on top of the one per frame
+    console.getPPU().catchUp(cpuCyclesToDots<NTSCTiming>(cpu.cycleCount));
+    uint64_t frames = console.getPPU().getFrameCount();
+    uint64_t nmis = cpu.memory[0x10];
+    CHECK_EQ(frames, 200);
+    CHECK_EQ(nmis, frames + 1);
+}
+
+int main()
+{
+    silenceTrace();
+    
+    testNMIAfterMultiByteInstruction();
+    testBRKReturnAddress();
+    testNMIPollLoop();
+    
+    return checkResult("cpu_interrupts");
+}
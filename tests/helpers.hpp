@@ -0,0 +1,29 @@
+//
+//  helpers.hpp
+//  emulator_6502
+//
+
+#pragma once
+
+#include "../src/CPU/6502emu.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+
+/*
+ Shared setup for the test programs that run code on a console
+ */
+
+/// Writes bytes into CPU memory, starting at address
+inline void load(cpu6502& cpu, uint16_t address, std::initializer_list<uint8_t> bytes)
+{
+    for (uint8_t byte : bytes)
+        cpu.memory[address++] = byte;
+}
+
+/// Silences the CPU's instruction trace, which is printed to std::cout for every instruction
+inline void silenceTrace()
+{
+    std::cout.setstate(std::ios::failbit);
+}
@@ -0,0 +1,61 @@
+//
+//  oam_dma.cpp
+//  emulator_6502
+//
+
+#include "check.hpp"
+#include "helpers.hpp"
+#include "../src/console/console.hpp"
+
+/*
+ OAM DMA halts the CPU for 513 cycles after STA $4014 (514 when the write lands on an odd cycle), so the PPU has moved
+ on by that many cycles' worth of dots by the time the next instruction touches it
+ */
+
+// Returns the cycle STA $4014 wrote on
+static uint64_t testStall(bool delayed)
+{
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, nullptr);
+    cpu6502& cpu = console.getCPU();
+    PPU& ppu = console.getPPU();
+    
+    // LDA $00 takes one cycle more than NOP, which moves the $4014 write to the other cycle parity
+    if (delayed)
+        load(cpu, 0x8000, { 0xA5, 0x00 });                 // LDA $00
+    else
+        load(cpu, 0x8000, { 0xEA, 0xEA });                 // NOP, NOP
+    
+    load(cpu, 0x8002, { 0xA9, 0x02, 0x8D, 0x14, 0x40,      // LDA #$02, STA $4014
+                        0x2C, 0x02, 0x20 });               // BIT $2002
+    for (int i = 0; i < 256; ++i)
+        cpu.memory[0x0200 + i] = static_cast<uint8_t>(i ^ 0x5A);
+    
+    cpu.pc.val = delayed ? 0x8000 : 0x8001;
+    cpu.emulate();
+    cpu.emulate();
+    
+    // STA absolute writes on its last (4th) cycle
+    const uint64_t writeCycle = cpu.cycleCount + 3;
+    cpu.emulate();
+    CHECK_EQ(cpu.cycleCount, writeCycle + 1 + 513 + (writeCycle & 1));
+    
+    // BIT $2002 reads on its last cycle, catching the PPU up to it
+    const uint64_t readCycle = cpu.cycleCount + 3;
+    cpu.emulate();
+    CHECK_EQ(ppu.getDotCount(), cpuCyclesToDots<NTSCTiming>(readCycle));
+    
+    for (int i = 0; i < 256; ++i)
+        CHECK_EQ(ppu.getOAM()[i], i ^ 0x5A);
+    
+    return writeCycle;
+}
+
+int main()
+{
+    silenceTrace();
+    
+    // Both cycle parities of the write are covered
+    CHECK((testStall(false) & 1) != (testStall(true) & 1));
+    
+    return checkResult("oam_dma");
+}
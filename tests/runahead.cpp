@@ -0,0 +1,146 @@
+//
+//  runahead.cpp
+//  emulator_6502
+//
+
+#include "check.hpp"
+#include "helpers.hpp"
+#include "../src/console/runahead.hpp"
+#include "../src/PPU/framehash.hpp"
+
+/*
+ Snapshots and run-ahead: restoring a snapshot rewinds exactly to it, and run-ahead presents the frame the console
+ would show N frames later while the emulation itself only advances one frame per displayed frame
+ */
+
+// NMI handler scrolls a counter through the nametables, so every frame looks different
+static void setup(ConsoleBase& console)
+{
+    cpu6502& cpu = console.getCPU();
+    
+    load(cpu, 0x8000, { 0xA9, 0x80, 0x8D, 0x00, 0x20,      // LDA #$80, STA $2000
+                        0xA9, 0x1E, 0x8D, 0x01, 0x20,      // LDA #$1E, STA $2001
+                        0x2C, 0x02, 0x20,                  // loop: BIT $2002
+                        0x4C, 0x0A, 0x80 });               // JMP loop
+    load(cpu, 0x8100, { 0xE6, 0x10,                        // INC $10
+                        0xA9, 0x20, 0x8D, 0x06, 0x20,      // LDA #$20, STA $2006
+                        0xA5, 0x10, 0x29, 0x1F, 0x8D, 0x06, 0x20,  // LDA $10, AND #$1F, STA $2006
+                        0xA5, 0x10, 0x8D, 0x07, 0x20,      // LDA $10, STA $2007
+                        0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20,    // LDA #0, STA $2005 (x2)
+                        0x40 });                           // RTI
+    cpu.memory[0xFFFA] = 0x00;
+    cpu.memory[0xFFFB] = 0x81;
+    
+    // Pseudo random pattern tables and a palette
+    PPU& ppu = console.getPPU();
+    uint32_t seed = 1;
+    
+    ppu.write(0x2006, 0x00);
+    ppu.write(0x2006, 0x00);
+    
+    for (int i = 0; i < 0x2000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        ppu.write(0x2007, (seed >> 16) & 0xFF);
+    }
+    
+    ppu.write(0x2006, 0x3F);
+    ppu.write(0x2006, 0x00);
+    
+    for (int i = 0; i < 32; i++)
+        ppu.write(0x2007, (i * 7) & 0x3F);
+    
+    cpu.pc.val = 0x8000;
+}
+
+// snapshot -> runFrame x N -> restore lands back on the snapshot, and replaying gives the same frames
+static void testSnapshotReplay(PPUMode mode)
+{
+    constexpr int FRAMES = 5;
+    
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, nullptr, mode);
+    setup(console);
+    
+    for (int i = 0; i < 10; i++)
+        console.runFrame();
+    
+    ConsoleState state;
+    console.saveState(state);
+    
+    const uint64_t frameCount = console.getPPU().getFrameCount();
+    const uint64_t cycle = console.getCPU().cycleCount;
+    
+    uint64_t frameNumbers[FRAMES];
+    uint64_t hashes[FRAMES];
+    
+    for (int i = 0; i < FRAMES; i++)
+    {
+        console.runFrame();
+        frameNumbers[i] = console.getPPU().getFrame().frameNumber;
+        hashes[i] = hashFrame(console.getPPU().getFrame());
+        CHECK_EQ(frameNumbers[i], frameCount + i + 1);
+    }
+    
+    console.loadState(state);
+    CHECK_EQ(console.getPPU().getFrameCount(), frameCount);
+    CHECK_EQ(console.getCPU().cycleCount, cycle);
+    
+    for (int i = 0; i < FRAMES; i++)
+    {
+        console.runFrame();
+        CHECK_EQ(console.getPPU().getFrame().frameNumber, frameNumbers[i]);
+        CHECK_EQ(hashFrame(console.getPPU().getFrame()), hashes[i]);
+    }
+}
+
+// Displayed frame i of a run-ahead of N is frame i + N of a plain run (with the PPU inline), and the timelines never
+// drift apart
+static void testRunAheadTimeline(int frames, PPUMode mode)
+{
+    constexpr int DISPLAYED = 60;
+    
+    FrameHashLog reference;
+    Console<NTSCTiming> plain(NametableMirroring::VERTICAL, nullptr);
+    setup(plain);
+    plain.setFrameHashLog(&reference);
+    
+    for (int i = 0; i < DISPLAYED + frames; i++)
+        plain.runFrame();
+    
+    FrameHashLog presented;
+    Console<NTSCTiming> console(NametableMirroring::VERTICAL, nullptr, mode);
+    setup(console);
+    console.setFrameHashLog(&presented);
+    RunAhead runAhead(console, frames);
+    
+    for (int i = 1; i <= DISPLAYED; i++)
+    {
+        runAhead.runFrame();
+        CHECK_EQ(console.getPPU().getFrameCount(), i);
+    }
+    
+    CHECK_EQ(presented.getHashes().size(), DISPLAYED);
+    CHECK_EQ(presented.getMissingFrames(), 0);
+    
+    for (size_t i = 0; i < presented.getHashes().size(); i++)
+    {
+        CHECK_EQ(presented.getFrameNumbers()[i], i + 1 + frames);
+        CHECK_EQ(presented.getHashes()[i], reference.getHashes()[i + frames]);
+    }
+}
+
+int main()
+{
+    silenceTrace();
+    
+    // The pipelined PPU has to present and restore exactly the frames of the inline one
+    for (PPUMode mode : { PPUMode::INLINE, PPUMode::PIPELINED })
+    {
+        testSnapshotReplay(mode);
+        testRunAheadTimeline(0, mode);
+        testRunAheadTimeline(1, mode);
+        testRunAheadTimeline(2, mode);
+    }
+    
+    return checkResult("runahead");
+}
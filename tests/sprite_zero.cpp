@@ -0,0 +1,216 @@
+//
+//  sprite_zero.cpp
+//  emulator_6502
+//
+
+#include "check.hpp"
+#include "../src/PPU/PPU.hpp"
+#include "../src/util/ppumem.hpp"
+#include "../src/util/scheduler.hpp"
+#include "../src/util/region.hpp"
+
+/*
+ Sprite 0 hit prediction: the dot predicted at the start of a frame must be the dot at which stepping the PPU one
+ dot at a time sets PPUSTATUS.S, for any OAM, scroll, mask and control layout
+ */
+
+// Exposes the status flag, so the hit can be observed without the side effects of a $2002 read
+class TestPPU : public PPU
+{
+public:
+    using PPU::PPU;
+    
+    bool spriteZeroHit() const { return m_regs.PPUSTATUS.S; }
+};
+
+struct Layout
+{
+    uint8_t ctrl;           // PPUCTRL: pattern tables, sprite size
+    uint8_t mask;           // PPUMASK: layers and left column clipping
+    uint8_t scrollX;
+    uint8_t scrollY;
+    uint8_t spriteX;
+    uint8_t spriteY;
+    uint8_t spriteTile;
+    uint8_t spriteAttributes;
+    uint32_t seed;          // Background tiles (0: every tile blank)
+};
+
+static void writeVRAM(PPU& ppu, uint16_t address, uint8_t value)
+{
+    ppu.write(0x2006, address >> 8);
+    ppu.write(0x2006, address & 0xFF);
+    ppu.write(0x2007, value);
+}
+
+static void setup(PPU& ppu, const Layout& layout)
+{
+    // Tile 0 is blank, tiles 1-15 have sparse pixels so hits depend on exact positions
+    for (uint16_t table = 0x0000; table < 0x2000; table += 0x1000)
+    {
+        for (int tile = 1; tile < 16; tile++)
+        {
+            for (int row = 0; row < 8; row++)
+            {
+                writeVRAM(ppu, table + (tile * 16) + row, static_cast<uint8_t>((tile * 37) >> (row & 3)) & 0x55);
+                writeVRAM(ppu, table + (tile * 16) + row + 8, static_cast<uint8_t>(tile << (row % 5)) & 0x81);
+            }
+        }
+    }
+    
+    uint32_t seed = layout.seed;
+    
+    for (uint16_t address = 0x2000; address < 0x2800; address++)
+    {
+        seed = seed * 1103515245 + 12345;
+        writeVRAM(ppu, address, layout.seed ? (seed >> 16) & 0x0F : 0);
+    }
+    
+    // Sprite 0, every other sprite off screen
+    ppu.write(0x2003, 0);
+    
+    for (int i = 0; i < 256; i++)
+        ppu.write(0x2004, 0xFF);
+    
+    ppu.write(0x2003, 0);
+    ppu.write(0x2004, layout.spriteY);
+    ppu.write(0x2004, layout.spriteTile);
+    ppu.write(0x2004, layout.spriteAttributes);
+    ppu.write(0x2004, layout.spriteX);
+    
+    ppu.write(0x2000, layout.ctrl);
+    ppu.write(0x2005, layout.scrollX);
+    ppu.write(0x2005, layout.scrollY);
+    ppu.write(0x2001, layout.mask);
+}
+
+/**
+ *  Runs one frame to get the scroll copied into v, then compares the prediction for the next frame with the dot
+ *  at which stepping one dot at a time sets the flag
+ *
+ *  @return Frame dot of the hit, or NO_SPRITE_ZERO_HIT
+ */
+static int32_t checkLayout(const Layout& layout)
+{
+    PPUMemory memory(NametableMirroring::VERTICAL);
+    TestPPU ppu(memory, nullptr);
+    
+    setup(ppu, layout);
+    ppu.step(PPU::DOTS_PER_SCANLINE * NTSCTiming::SCANLINES_PER_FRAME);
+    
+    const int32_t predicted = ppu.getSpriteZeroHitDot();
+    CHECK(ppu.verifySpriteZeroPrediction());
+    
+    int32_t stepped = PPU::NO_SPRITE_ZERO_HIT;
+    
+    for (int32_t dot = 0; dot < 240 * PPU::DOTS_PER_SCANLINE; dot++)
+    {
+        ppu.step(1);
+        
+        // The flag shows once the dot of the hit has been executed
+        if (ppu.spriteZeroHit())
+        {
+            stepped = dot;
+            break;
+        }
+    }
+    
+    if (predicted != stepped)
+    {
+        std::fprintf(stderr, "ctrl %02x mask %02x scroll %d,%d sprite %d,%d tile %d attr %02x seed %u: "
+                     "predicted %d, stepped %d\n", layout.ctrl, layout.mask, layout.scrollX, layout.scrollY,
+                     layout.spriteX, layout.spriteY, layout.spriteTile, layout.spriteAttributes, layout.seed,
+                     predicted, stepped);
+    }
+    
+    CHECK_EQ(predicted, stepped);
+    return stepped;
+}
+
+// Only writes that can move the hit predict the SPRITE_ZERO_HIT event of the frame being drawn again
+static void testEventRescheduling()
+{
+    PPUMemory memory(NametableMirroring::VERTICAL);
+    TestPPU ppu(memory, nullptr);
+    Scheduler scheduler;
+    
+    setup(ppu, { 0x00, 0x1E, 0, 0, 100, 50, 3, 0x00, 1 });
+    ppu.setScheduler(&scheduler);
+    ppu.step(PPU::DOTS_PER_SCANLINE * NTSCTiming::SCANLINES_PER_FRAME);
+    
+    const uint64_t frameStart = ppu.getDotCount();
+    const uint64_t hitDot = frameStart + ppu.getSpriteZeroHitDot() + 1;
+    CHECK_EQ(scheduler.nextEventDot(), hitDot);
+    
+    // OAMADDR doesn't change OAM
+    ppu.step(PPU::DOTS_PER_SCANLINE * 10 + 100);
+    ppu.write(0x2003, 0x10);
+    CHECK_EQ(scheduler.nextEventDot(), hitDot);
+    
+    // Scrolling mid frame moves the hit, which fires exactly when the flag becomes visible
+    ppu.write(0x2005, 0x0C);
+    const uint64_t movedDot = scheduler.nextEventDot();
+    CHECK(movedDot != hitDot);
+    
+    while (!ppu.spriteZeroHit() && ppu.getDotCount() < frameStart + 240 * PPU::DOTS_PER_SCANLINE)
+        ppu.step(1);
+    
+    CHECK_EQ(ppu.getDotCount(), movedDot);
+    
+    // Hiding the sprites on line 20 of the next frame leaves no hit to wait for, the next event is the end of the frame
+    ppu.step(PPU::DOTS_PER_SCANLINE * (NTSCTiming::SCANLINES_PER_FRAME + 20) - (ppu.getDotCount() - frameStart));
+    CHECK(scheduler.nextEventDot() < ppu.getDotCount() + PPU::DOTS_PER_SCANLINE * 40);
+    ppu.write(0x2001, 0x0E);
+    CHECK(scheduler.nextEventDot() > ppu.getDotCount() + PPU::DOTS_PER_SCANLINE * 200);
+}
+
+int main()
+{
+    testEventRescheduling();
+    
+    // Hand picked layouts: a plain hit, clipping, right edge, no background, rendering off, 8x16, flips, scroll
+    const Layout layouts[] = {
+        { 0x00, 0x1E,   0,   0, 100,  50,  3, 0x00, 1 },
+        { 0x00, 0x18,   0,   0,   2,  20,  7, 0x00, 2 },     // Left 8 pixels clipped
+        { 0x00, 0x1E,   0,   0,   2,  20,  7, 0x00, 2 },
+        { 0x00, 0x1E,   0,   0, 255, 100,  9, 0x00, 3 },     // Never hits at x = 255
+        { 0x00, 0x1E,   0,   0, 250, 100,  9, 0x00, 3 },
+        { 0x00, 0x1E,   0,   0,  60,  60,  5, 0x00, 0 },     // Blank background
+        { 0x00, 0x08,   0,   0,  60,  60,  5, 0x00, 4 },     // Sprites hidden
+        { 0x00, 0x00,   0,   0,  60,  60,  5, 0x00, 4 },     // Rendering off
+        { 0x20, 0x1E,   0,   0,  30, 200,  6, 0x00, 5 },     // 8x16 sprites
+        { 0x18, 0x1E,   0,   0,  30, 120, 11, 0xC0, 6 },     // Pattern tables swapped, flipped both ways
+        { 0x00, 0x1E, 200,  37, 120,  90, 13, 0x40, 7 },     // Scrolled into the next nametable
+        { 0x01, 0x1E,  13, 229, 180,  10, 15, 0x80, 8 },     // Base nametable 1, vertical scroll past the attributes
+        { 0x00, 0x1E,   0,   0,  10, 239,  3, 0x00, 9 },     // Below the visible frame
+    };
+    
+    for (const Layout& layout : layouts)
+        checkLayout(layout);
+    
+    // Random layouts, most of which hit somewhere
+    uint32_t seed = 0xC0FFEE;
+    auto next = [&seed] { seed = seed * 1664525 + 1013904223; return static_cast<uint8_t>(seed >> 24); };
+    
+    int hits = 0;
+    
+    for (int i = 0; i < 64; i++)
+    {
+        Layout layout;
+        layout.ctrl = next() & 0x3B;
+        layout.mask = (next() & 0x01) ? 0x1E : 0x18;
+        layout.scrollX = next();
+        layout.scrollY = next() % 240;
+        layout.spriteX = next();
+        layout.spriteY = next() % 240;
+        layout.spriteTile = (next() % 15) + 1;
+        layout.spriteAttributes = next() & 0xC0;
+        layout.seed = i + 100;
+        
+        hits += checkLayout(layout) != PPU::NO_SPRITE_ZERO_HIT;
+    }
+    
+    CHECK(hits > 32);
+    
+    return checkResult("sprite_zero");
+}